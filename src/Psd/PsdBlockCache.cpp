@@ -0,0 +1,485 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdBlockCache.h"
+
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAssert.h"
+#include <mutex>
+#include <cstring>
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct BlockCache::Entry
+{
+	Entry* lruPrev;					// towards more recently used entries, unused for pinned entries
+	Entry* lruNext;					// towards less recently used entries, unused for pinned entries
+	Entry* bucketNext;
+	uint64_t identity;
+	uint64_t blockIndex;
+	uint64_t hash;
+	uint32_t size;
+	bool isPinned;
+};
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct BlockCache::Shard
+{
+	std::mutex mutex;
+
+	Entry** buckets;
+	uint64_t bucketMask;
+	Entry* lruHead;
+	Entry* lruTail;
+
+	uint64_t capacity;
+	uint64_t pinCapacity;
+	uint64_t cachedBytes;
+	uint64_t pinnedBytes;
+
+	uint64_t hitCount;
+	uint64_t missCount;
+	uint64_t insertCount;
+	uint64_t evictionCount;
+};
+
+
+namespace
+{
+	typedef std::lock_guard<std::mutex> ShardLock;
+
+	// block data directly follows the entry, keeping the alignment guaranteed by the allocator
+	static const size_t ENTRY_HEADER_SIZE = 64u;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static uint64_t Hash(uint64_t identity, uint64_t blockIndex)
+	{
+		// the finalizer of splitmix64, which spreads consecutive block indices over all shards and buckets
+		uint64_t x = identity * 0x9E3779B97F4A7C15ull + blockIndex;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Entry>
+	static uint8_t* GetData(Entry* entry)
+	{
+		static_assert(sizeof(Entry) <= ENTRY_HEADER_SIZE, "Entry does not fit into its header.");
+
+		return reinterpret_cast<uint8_t*>(entry) + ENTRY_HEADER_SIZE;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Shard, typename Entry>
+	static void LinkFront(Shard* shard, Entry* entry)
+	{
+		entry->lruPrev = nullptr;
+		entry->lruNext = shard->lruHead;
+		if (shard->lruHead)
+		{
+			shard->lruHead->lruPrev = entry;
+		}
+		else
+		{
+			shard->lruTail = entry;
+		}
+
+		shard->lruHead = entry;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Shard, typename Entry>
+	static void Unlink(Shard* shard, Entry* entry)
+	{
+		if (entry->lruPrev)
+		{
+			entry->lruPrev->lruNext = entry->lruNext;
+		}
+		else
+		{
+			shard->lruHead = entry->lruNext;
+		}
+
+		if (entry->lruNext)
+		{
+			entry->lruNext->lruPrev = entry->lruPrev;
+		}
+		else
+		{
+			shard->lruTail = entry->lruPrev;
+		}
+
+		entry->lruPrev = nullptr;
+		entry->lruNext = nullptr;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Shard, typename Entry>
+	static bool PinEntry(Shard* shard, Entry* entry)
+	{
+		if (entry->isPinned)
+			return true;
+
+		if (shard->pinnedBytes + entry->size > shard->pinCapacity)
+			return false;
+
+		Unlink(shard, entry);
+		entry->isPinned = true;
+		shard->pinnedBytes += entry->size;
+
+		return true;
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+BlockCache::BlockCache(Allocator* allocator, uint64_t capacity)
+	: m_allocator(allocator)
+	, m_shards(nullptr)
+	, m_shardCount(0u)
+	, m_blockSize(0u)
+{
+	Initialize(capacity, DEFAULT_BLOCK_SIZE, DEFAULT_SHARD_COUNT);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+BlockCache::BlockCache(Allocator* allocator, uint64_t capacity, uint32_t blockSize, unsigned int shardCount)
+	: m_allocator(allocator)
+	, m_shards(nullptr)
+	, m_shardCount(0u)
+	, m_blockSize(0u)
+{
+	Initialize(capacity, blockSize, shardCount);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+BlockCache::~BlockCache(void)
+{
+	for (unsigned int i = 0u; i < m_shardCount; ++i)
+	{
+		Shard* shard = m_shards[i];
+		for (uint64_t j = 0u; j <= shard->bucketMask; ++j)
+		{
+			Entry* entry = shard->buckets[j];
+			while (entry)
+			{
+				Entry* next = entry->bucketNext;
+				m_allocator->Free(entry);
+				entry = next;
+			}
+		}
+
+		memoryUtil::FreeArray(m_allocator, shard->buckets);
+		memoryUtil::Free(m_allocator, shard);
+	}
+
+	memoryUtil::FreeArray(m_allocator, m_shards);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint32_t BlockCache::GetBlockSize(void) const
+{
+	return m_blockSize;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool BlockCache::Read(uint64_t identity, uint64_t blockIndex, void* buffer, uint32_t offset, uint32_t count)
+{
+	const uint64_t hash = Hash(identity, blockIndex);
+	Shard* shard = GetShard(hash);
+
+	ShardLock lock(shard->mutex);
+
+	Entry* entry = Find(shard, hash, identity, blockIndex);
+	if (!entry || (offset > entry->size) || (count > entry->size - offset))
+	{
+		++shard->missCount;
+		return false;
+	}
+
+	++shard->hitCount;
+	if (!entry->isPinned)
+	{
+		Unlink(shard, entry);
+		LinkFront(shard, entry);
+	}
+
+	memcpy(buffer, GetData(entry) + offset, count);
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool BlockCache::Insert(uint64_t identity, uint64_t blockIndex, const void* data, uint32_t size, bool pin)
+{
+	PSD_ASSERT(size <= m_blockSize, "Block of %u bytes is larger than the block size of %u bytes.", size, m_blockSize);
+
+	const uint64_t hash = Hash(identity, blockIndex);
+	Shard* shard = GetShard(hash);
+
+	ShardLock lock(shard->mutex);
+
+	Entry* entry = Find(shard, hash, identity, blockIndex);
+	if (entry)
+		return pin ? PinEntry(shard, entry) : true;
+
+	if (pin && (shard->pinnedBytes + size > shard->pinCapacity))
+		return false;
+
+	// only unpinned blocks can be evicted, so do not throw any of them away if the block would not fit afterwards anyway
+	if (shard->pinnedBytes + size > shard->capacity)
+		return false;
+
+	Evict(shard, size);
+
+	entry = static_cast<Entry*>(m_allocator->Allocate(ENTRY_HEADER_SIZE + size, 16u));
+	entry->identity = identity;
+	entry->blockIndex = blockIndex;
+	entry->hash = hash;
+	entry->size = size;
+	entry->isPinned = pin;
+	memcpy(GetData(entry), data, size);
+
+	Entry*& bucket = shard->buckets[(hash >> 32u) & shard->bucketMask];
+	entry->bucketNext = bucket;
+	bucket = entry;
+
+	entry->lruPrev = nullptr;
+	entry->lruNext = nullptr;
+	if (pin)
+	{
+		shard->pinnedBytes += size;
+	}
+	else
+	{
+		LinkFront(shard, entry);
+	}
+
+	shard->cachedBytes += size;
+	++shard->insertCount;
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool BlockCache::Pin(uint64_t identity, uint64_t blockIndex)
+{
+	const uint64_t hash = Hash(identity, blockIndex);
+	Shard* shard = GetShard(hash);
+
+	ShardLock lock(shard->mutex);
+
+	Entry* entry = Find(shard, hash, identity, blockIndex);
+	if (!entry)
+		return false;
+
+	return PinEntry(shard, entry);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void BlockCache::Invalidate(uint64_t identity)
+{
+	for (unsigned int i = 0u; i < m_shardCount; ++i)
+	{
+		Shard* shard = m_shards[i];
+		ShardLock lock(shard->mutex);
+
+		for (uint64_t j = 0u; j <= shard->bucketMask; ++j)
+		{
+			Entry* entry = shard->buckets[j];
+			while (entry)
+			{
+				Entry* next = entry->bucketNext;
+				if (entry->identity == identity)
+				{
+					Remove(shard, entry);
+				}
+
+				entry = next;
+			}
+		}
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void BlockCache::Invalidate(uint64_t identity, uint64_t blockIndex, uint64_t blockCount)
+{
+	for (uint64_t i = blockIndex; i < blockIndex + blockCount; ++i)
+	{
+		const uint64_t hash = Hash(identity, i);
+		Shard* shard = GetShard(hash);
+
+		ShardLock lock(shard->mutex);
+
+		Entry* entry = Find(shard, hash, identity, i);
+		if (entry)
+		{
+			Remove(shard, entry);
+		}
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+BlockCache::Statistics BlockCache::GetStatistics(void) const
+{
+	Statistics statistics = {};
+	for (unsigned int i = 0u; i < m_shardCount; ++i)
+	{
+		Shard* shard = m_shards[i];
+		ShardLock lock(shard->mutex);
+
+		statistics.hitCount += shard->hitCount;
+		statistics.missCount += shard->missCount;
+		statistics.insertCount += shard->insertCount;
+		statistics.evictionCount += shard->evictionCount;
+		statistics.cachedBytes += shard->cachedBytes;
+		statistics.pinnedBytes += shard->pinnedBytes;
+	}
+
+	return statistics;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void BlockCache::Initialize(uint64_t capacity, uint32_t blockSize, unsigned int shardCount)
+{
+	PSD_ASSERT(blockSize != 0u, "Block size must not be zero.");
+	PSD_ASSERT(shardCount != 0u, "Shard count must not be zero.");
+
+	// size the buckets of each shard for the number of full blocks it can hold
+	const uint64_t shardCapacity = capacity / shardCount;
+	const uint64_t blockCount = shardCapacity / blockSize;
+	uint64_t bucketCount = 8u;
+	while (bucketCount < blockCount)
+	{
+		bucketCount *= 2u;
+	}
+
+	m_shards = memoryUtil::AllocateArray<Shard*>(m_allocator, shardCount);
+	for (unsigned int i = 0u; i < shardCount; ++i)
+	{
+		Shard* shard = memoryUtil::Allocate<Shard>(m_allocator);
+		shard->buckets = memoryUtil::AllocateArray<Entry*>(m_allocator, static_cast<size_t>(bucketCount));
+		memset(shard->buckets, 0, static_cast<size_t>(bucketCount) * sizeof(Entry*));
+		shard->bucketMask = bucketCount - 1u;
+		shard->lruHead = nullptr;
+		shard->lruTail = nullptr;
+		shard->capacity = shardCapacity;
+		shard->pinCapacity = shardCapacity * MAX_PINNED_PERCENT / 100u;
+		shard->cachedBytes = 0u;
+		shard->pinnedBytes = 0u;
+		shard->hitCount = 0u;
+		shard->missCount = 0u;
+		shard->insertCount = 0u;
+		shard->evictionCount = 0u;
+
+		m_shards[i] = shard;
+	}
+
+	m_shardCount = shardCount;
+	m_blockSize = blockSize;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+BlockCache::Shard* BlockCache::GetShard(uint64_t hash) const
+{
+	return m_shards[hash % m_shardCount];
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+BlockCache::Entry* BlockCache::Find(Shard* shard, uint64_t hash, uint64_t identity, uint64_t blockIndex) const
+{
+	Entry* entry = shard->buckets[(hash >> 32u) & shard->bucketMask];
+	while (entry)
+	{
+		if ((entry->hash == hash) && (entry->identity == identity) && (entry->blockIndex == blockIndex))
+			return entry;
+
+		entry = entry->bucketNext;
+	}
+
+	return nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void BlockCache::Evict(Shard* shard, uint64_t size)
+{
+	// pinned entries are not part of the LRU list, so they are never picked
+	while ((shard->cachedBytes + size > shard->capacity) && shard->lruTail)
+	{
+		Remove(shard, shard->lruTail);
+		++shard->evictionCount;
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void BlockCache::Remove(Shard* shard, Entry* entry)
+{
+	Entry** link = &shard->buckets[(entry->hash >> 32u) & shard->bucketMask];
+	while (*link != entry)
+	{
+		link = &(*link)->bucketNext;
+	}
+
+	*link = entry->bucketNext;
+
+	if (entry->isPinned)
+	{
+		shard->pinnedBytes -= entry->size;
+	}
+	else
+	{
+		Unlink(shard, entry);
+	}
+
+	shard->cachedBytes -= entry->size;
+	m_allocator->Free(entry);
+}
+
+PSD_NAMESPACE_END
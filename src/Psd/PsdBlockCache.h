@@ -0,0 +1,103 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+class Allocator;
+
+
+/// \ingroup Files
+/// \brief A bounded cache of fixed-size file blocks, meant to be shared by all \ref CachedFile instances of a process.
+/// \details Blocks are keyed by a caller-provided file identity and the index of the block in that file. The cache is split
+/// into shards, each guarded by its own mutex, so that threads reading different blocks rarely contend.
+///
+/// Each shard holds at most its share of the total capacity in bytes. Whenever a block does not fit, the least recently
+/// used blocks are evicted until it does, taking their actual size into account (the last block of a file is usually
+/// smaller than the block size). Pinned blocks are never evicted, but still count towards the capacity. So that pinned blocks
+/// cannot starve all other blocks, they may only take up MAX_PINNED_PERCENT of each shard's capacity, further pins are refused.
+/// \remark Blocks are allocated and freed using the given allocator from whichever thread inserts or evicts them, so the
+/// allocator must be thread-safe if the cache is shared between threads.
+/// \sa CachedFile
+class BlockCache
+{
+public:
+	/// Cache statistics, see GetStatistics().
+	struct Statistics
+	{
+		uint64_t hitCount;			///< Number of block lookups that found the block.
+		uint64_t missCount;			///< Number of block lookups that did not find the block.
+		uint64_t insertCount;		///< Number of blocks inserted into the cache.
+		uint64_t evictionCount;		///< Number of blocks evicted to make room for other blocks.
+		uint64_t cachedBytes;		///< Number of bytes currently held by the cache, including pinned blocks.
+		uint64_t pinnedBytes;		///< Number of bytes currently held by pinned blocks.
+	};
+
+	/// Default size of a block.
+	static const uint32_t DEFAULT_BLOCK_SIZE = 64u * 1024u;
+
+	/// Default number of shards.
+	static const unsigned int DEFAULT_SHARD_COUNT = 16u;
+
+	/// Share of each shard's capacity in percent that may be taken up by pinned blocks.
+	static const unsigned int MAX_PINNED_PERCENT = 50u;
+
+	/// Constructor holding up to \a capacity bytes in blocks of the default size.
+	BlockCache(Allocator* allocator, uint64_t capacity);
+
+	/// Constructor holding up to \a capacity bytes in blocks of \a blockSize bytes, split into \a shardCount shards.
+	BlockCache(Allocator* allocator, uint64_t capacity, uint32_t blockSize, unsigned int shardCount);
+
+	/// Destructor freeing all blocks, including pinned ones.
+	~BlockCache(void);
+
+	/// Returns the size of a block.
+	uint32_t GetBlockSize(void) const;
+
+	/// Copies count bytes starting at offset from a cached block into the buffer, and returns whether the block was found.
+	bool Read(uint64_t identity, uint64_t blockIndex, void* buffer, uint32_t offset, uint32_t count);
+
+	/// Inserts a copy of a block holding size bytes, optionally pinning it. Blocks that are already cached are left untouched,
+	/// apart from being pinned if requested. Returns whether the block is cached, and pinned if requested, afterwards.
+	/// \remark If the block does not fit because the shard is filled with pinned blocks, it is not inserted and nothing is
+	/// evicted.
+	bool Insert(uint64_t identity, uint64_t blockIndex, const void* data, uint32_t size, bool pin);
+
+	/// Pins a cached block so that it is never evicted, and returns whether the block was found and pinned. Pins that would
+	/// exceed the share of pinned blocks are refused.
+	bool Pin(uint64_t identity, uint64_t blockIndex);
+
+	/// Removes all blocks belonging to a file, including pinned ones. This must be called whenever the file's contents change.
+	/// \remark This visits every block held by the cache.
+	void Invalidate(uint64_t identity);
+
+	/// Removes \a blockCount blocks starting at \a blockIndex belonging to a file, including pinned ones. This must be called
+	/// whenever parts of the file's contents change.
+	void Invalidate(uint64_t identity, uint64_t blockIndex, uint64_t blockCount);
+
+	/// Returns the statistics gathered by all shards so far.
+	Statistics GetStatistics(void) const;
+
+private:
+	struct Entry;
+	struct Shard;
+
+	// the shards are owned by the cache, hence it cannot be copied
+	BlockCache(const BlockCache&);
+	BlockCache& operator=(const BlockCache&);
+
+	void Initialize(uint64_t capacity, uint32_t blockSize, unsigned int shardCount);
+	Shard* GetShard(uint64_t hash) const;
+	Entry* Find(Shard* shard, uint64_t hash, uint64_t identity, uint64_t blockIndex) const;
+	void Evict(Shard* shard, uint64_t size);
+	void Remove(Shard* shard, Entry* entry);
+
+	Allocator* m_allocator;
+	Shard** m_shards;
+	unsigned int m_shardCount;
+	uint32_t m_blockSize;
+};
+
+PSD_NAMESPACE_END
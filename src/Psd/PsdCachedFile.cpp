@@ -0,0 +1,274 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdCachedFile.h"
+
+#include "PsdBlockCache.h"
+#include "PsdAllocator.h"
+#include "PsdAssert.h"
+#include "PsdLog.h"
+#include "Psdinttypes.h"
+#include <cstring>
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+CachedFile::CachedFile(Allocator* allocator, File* file, BlockCache* cache, uint64_t identity)
+	: File(allocator)
+	, m_file(file)
+	, m_cache(cache)
+	, m_identity(identity)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::Pin(uint64_t position, uint64_t count)
+{
+	if (count == 0u)
+		return true;
+
+	const uint32_t blockSize = m_cache->GetBlockSize();
+	const uint64_t firstBlock = position / blockSize;
+	const uint64_t lastBlock = (position + count - 1u) / blockSize;
+
+	uint8_t* staging = nullptr;
+	bool success = true;
+	for (uint64_t i = firstBlock; i <= lastBlock; ++i)
+	{
+		if (m_cache->Pin(m_identity, i))
+			continue;
+
+		if (!staging)
+		{
+			staging = static_cast<uint8_t*>(m_allocator->Allocate(blockSize, 16u));
+		}
+
+		uint32_t size = 0u;
+		if (!ReadBlock(i, staging, size, true))
+		{
+			success = false;
+			break;
+		}
+	}
+
+	m_allocator->Free(staging);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::ReadBlock(uint64_t blockIndex, uint8_t* staging, uint32_t& size, bool pin)
+{
+	// blocks are always read in full, so that the cached copy can serve any later read touching the block
+	const uint32_t blockSize = m_cache->GetBlockSize();
+	const uint64_t fileSize = m_file->GetSize();
+	const uint64_t position = blockIndex * blockSize;
+	if (position >= fileSize)
+	{
+		PSD_ERROR("CachedFile", "Block at file position %" PRIu64 " lies outside of the file, file size is %" PRIu64 ".", position, fileSize);
+		return false;
+	}
+
+	size = (fileSize - position < blockSize) ? static_cast<uint32_t>(fileSize - position) : blockSize;
+	if (!m_file->ReadSync(staging, size, position))
+		return false;
+
+	// plain reads are served from the staging buffer either way, but blocks read for pinning must end up pinned
+	const bool isCached = m_cache->Insert(m_identity, blockIndex, staging, size, pin);
+
+	return isCached || !pin;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void CachedFile::InvalidateBlocks(uint64_t position, uint64_t count)
+{
+	// only the blocks overlapping a write are removed, all other blocks of the file stay valid
+	if (count == 0u)
+		return;
+
+	const uint32_t blockSize = m_cache->GetBlockSize();
+	const uint64_t firstBlock = position / blockSize;
+	const uint64_t lastBlock = (position + count - 1u) / blockSize;
+	m_cache->Invalidate(m_identity, firstBlock, lastBlock - firstBlock + 1u);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoOpenRead(const wchar_t* filename)
+{
+	return m_file->OpenRead(filename);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoOpenWrite(const wchar_t* filename)
+{
+	// opening a file for writing truncates it
+	m_cache->Invalidate(m_identity);
+
+	return m_file->OpenWrite(filename);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoClose(void)
+{
+	return m_file->Close();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation CachedFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	if (!DoReadSync(buffer, count, position))
+		return nullptr;
+
+	// the read has already finished, so any non-null object will do
+	return static_cast<File::ReadOperation>(buffer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoWaitForRead(File::ReadOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation CachedFile::DoWrite(const void* buffer, uint32_t count, uint64_t position)
+{
+	InvalidateBlocks(position, count);
+
+	return m_file->Write(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoWaitForWrite(File::WriteOperation& operation)
+{
+	return m_file->WaitForWrite(operation);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	const uint32_t blockSize = m_cache->GetBlockSize();
+	uint8_t* destination = static_cast<uint8_t*>(buffer);
+	uint8_t* staging = nullptr;
+
+	bool success = true;
+	while (count != 0u)
+	{
+		const uint64_t blockIndex = position / blockSize;
+		const uint32_t offset = static_cast<uint32_t>(position - blockIndex * blockSize);
+		const uint32_t toCopy = (blockSize - offset < count) ? (blockSize - offset) : count;
+
+		if (!m_cache->Read(m_identity, blockIndex, destination, offset, toCopy))
+		{
+			if (!staging)
+			{
+				staging = static_cast<uint8_t*>(m_allocator->Allocate(blockSize, 16u));
+			}
+
+			uint32_t size = 0u;
+			if (!ReadBlock(blockIndex, staging, size, false))
+			{
+				success = false;
+				break;
+			}
+
+			if (offset + toCopy > size)
+			{
+				PSD_ERROR("CachedFile", "Cannot read %u bytes from file position %" PRIu64 ".", toCopy, position);
+				success = false;
+				break;
+			}
+
+			memcpy(destination, staging + offset, toCopy);
+		}
+
+		destination += toCopy;
+		position += toCopy;
+		count -= toCopy;
+	}
+
+	m_allocator->Free(staging);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoWriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	InvalidateBlocks(position, count);
+
+	return m_file->WriteSync(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoWriteBatch(const WriteRequest* requests, unsigned int count)
+{
+	for (unsigned int i = 0u; i < count; ++i)
+	{
+		InvalidateBlocks(requests[i].position, requests[i].count);
+	}
+
+	return m_file->WriteBatch(requests, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoPreallocate(uint64_t size)
+{
+	return m_file->Preallocate(size);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool CachedFile::DoPrefetch(uint64_t position, uint64_t count)
+{
+	return m_file->Prefetch(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* CachedFile::DoGetSpan(uint64_t position, uint32_t count) const
+{
+	return m_file->GetSpan(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t CachedFile::DoGetSize(void) const
+{
+	return m_file->GetSize();
+}
+
+PSD_NAMESPACE_END
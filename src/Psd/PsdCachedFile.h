@@ -0,0 +1,65 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+class BlockCache;
+
+
+/// \ingroup Files
+/// \brief File decorator that serves reads of any other file from a shared \ref BlockCache.
+/// \details Reads are split into blocks of the cache's block size. Blocks found in the cache are copied from there, all other
+/// blocks are read in full from the wrapped file and inserted into the cache, so that subsequent reads of the same file - by
+/// this or any other CachedFile using the same identity - do not touch the wrapped file at all.
+///
+/// The identity must uniquely denote the file's contents across the process, e.g. a hash of its path and modification
+/// time. Writes are forwarded to the wrapped file and invalidate the cached blocks they overlap. Spans are forwarded as well,
+/// so that files which already hold their contents in memory bypass the cache.
+/// \remark Blocks that are read on every open, such as the ones holding the header, image resources and layer records, can be
+/// pinned using Pin() so that they are never evicted. These sections span the file from its start up to the data of the
+/// first channel of the first layer, see \ref Channel::fileOffset.
+/// \sa File BlockCache
+class CachedFile : public File
+{
+public:
+	/// Constructor wrapping the given file, which is opened and closed through the decorator.
+	CachedFile(Allocator* allocator, File* file, BlockCache* cache, uint64_t identity);
+
+	/// Reads all blocks overlapping count bytes starting at position into the cache and pins them, and returns whether
+	/// the operation was successful. This fails if the blocks would exceed the cache's share of pinned blocks.
+	bool Pin(uint64_t position, uint64_t count);
+
+private:
+	bool ReadBlock(uint64_t blockIndex, uint8_t* staging, uint32_t& size, bool pin);
+	void InvalidateBlocks(uint64_t position, uint64_t count);
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWriteSync(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWriteBatch(const WriteRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual bool DoPreallocate(uint64_t size) PSD_OVERRIDE;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count) PSD_OVERRIDE;
+	virtual const void* DoGetSpan(uint64_t position, uint32_t count) const PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	File* m_file;
+	BlockCache* m_cache;
+	uint64_t m_identity;
+};
+
+PSD_NAMESPACE_END
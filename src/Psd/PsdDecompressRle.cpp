@@ -4,13 +4,55 @@
 #include "PsdPch.h"
 #include "PsdDecompressRle.h"
 
+#include "PsdExecutor.h"
 #include "PsdAssert.h"
 #include "PsdLog.h"
 #include <cstring>
 
+#if !defined(PSD_USE_SSE)
+	#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+		#define PSD_USE_SSE 1
+	#else
+		#define PSD_USE_SSE 0
+	#endif
+#endif
+
+#if PSD_USE_SSE
+	#include <emmintrin.h>
+#endif
+
 
 PSD_NAMESPACE_BEGIN
 
+namespace
+{
+	// a single token expands to at most 128 bytes, and is followed by at most 128 bytes of data
+	static const unsigned int MAX_TOKEN_SIZE = 128u;
+
+	// rows are only split into separate tasks if each task gets at least this many bytes to decompress
+	static const unsigned int MIN_TASK_SIZE = 256u * 1024u;
+	static const unsigned int MAX_TASK_COUNT = 32u;
+
+
+	struct RowRange
+	{
+		const uint8_t* src;
+		unsigned int srcSize;
+		uint8_t* dest;
+		unsigned int size;
+	};
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void DecompressRowRange(void* data)
+	{
+		const RowRange* range = static_cast<const RowRange*>(data);
+		imageUtil::DecompressRle(range->src, range->srcSize, range->dest, range->size);
+	}
+}
+
+
 namespace imageUtil
 {
 	// ---------------------------------------------------------------------------------------------------------------------
@@ -20,19 +62,65 @@ namespace imageUtil
 		PSD_ASSERT_NOT_NULL(src);
 		PSD_ASSERT_NOT_NULL(dest);
 
-		unsigned int bytesRead = 0u;
-		unsigned int offset = 0u;
-		while (offset < size)
+		const uint8_t* srcEnd = src + srcSize;
+		uint8_t* destEnd = dest + size;
+
+#if PSD_USE_SSE
+		// as long as even the largest token fits into both buffers, tokens are expanded using whole 16-byte loads and
+		// stores without checking any bounds. stores may write past the end of a token, but those bytes are overwritten
+		// by the tokens that follow.
+		if ((srcSize > MAX_TOKEN_SIZE) && (size >= MAX_TOKEN_SIZE))
 		{
-			if (bytesRead >= srcSize)
+			const uint8_t* srcFastEnd = srcEnd - MAX_TOKEN_SIZE;
+			const uint8_t* destFastEnd = destEnd - MAX_TOKEN_SIZE;
+			while ((src < srcFastEnd) && (dest <= destFastEnd))
+			{
+				const uint8_t byte = *src++;
+
+				// 0x81 - 0XFF
+				if (byte > 0x80)
+				{
+					// next 257-byte bytes are replicated from the next source byte
+					const unsigned int count = static_cast<unsigned int>(257 - byte);
+					const __m128i value = _mm_set1_epi8(static_cast<char>(*src++));
+					for (unsigned int i = 0u; i < count; i += 16u)
+					{
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), value);
+					}
+
+					dest += count;
+				}
+				// 0x00 - 0x7F
+				else if (byte < 0x80)
+				{
+					// copy next byte+1 bytes
+					const unsigned int count = static_cast<unsigned int>(byte + 1);
+					for (unsigned int i = 0u; i < count; i += 16u)
+					{
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+					}
+
+					src += count;
+					dest += count;
+				}
+
+				// byte == -128 (0x80) is a no-op
+			}
+		}
+#endif
+
+		// the remaining tokens near the end of either buffer are expanded one by one, never reading or writing out of bounds.
+		// bytes that cannot be decoded from malformed data are set to zero.
+		while (dest < destEnd)
+		{
+			if (src >= srcEnd)
 			{
 				PSD_ERROR("DecompressRle", "Malformed RLE data encountered");
+				memset(dest, 0, static_cast<size_t>(destEnd - dest));
 				return;
 			}
 
 			const uint8_t byte = *src++;
-			++bytesRead;
-
 			if (byte == 0x80)
 			{
 				// byte == -128 (0x80) is a no-op
@@ -42,25 +130,106 @@ namespace imageUtil
 			{
 				// next 257-byte bytes are replicated from the next source byte
 				const unsigned int count = static_cast<unsigned int>(257 - byte);
+				const unsigned int destLeft = static_cast<unsigned int>(destEnd - dest);
+				if ((src >= srcEnd) || (count > destLeft))
+				{
+					PSD_ERROR("DecompressRle", "Malformed RLE data encountered");
+					memset(dest, (src < srcEnd) ? *src : 0, destLeft);
+					return;
+				}
 
-				memset(dest + offset, *src++, count);
-				offset += count;
-
-				++bytesRead;
+				memset(dest, *src++, count);
+				dest += count;
 			}
 			// 0x00 - 0x7F
 			else
 			{
 				// copy next byte+1 bytes 1-by-1
 				const unsigned int count = static_cast<unsigned int>(byte + 1);
-				
-				memcpy(dest + offset, src, count);
+				const unsigned int srcLeft = static_cast<unsigned int>(srcEnd - src);
+				const unsigned int destLeft = static_cast<unsigned int>(destEnd - dest);
+				if ((count > srcLeft) || (count > destLeft))
+				{
+					PSD_ERROR("DecompressRle", "Malformed RLE data encountered");
+					const unsigned int toCopy = (srcLeft < destLeft) ? srcLeft : destLeft;
+					memcpy(dest, src, toCopy);
+					memset(dest + toCopy, 0, destLeft - toCopy);
+					return;
+				}
+
+				memcpy(dest, src, count);
 
 				src += count;
-				offset += count;
+				dest += count;
+			}
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	void DecompressRleRows(const uint8_t* PSD_RESTRICT src, const uint16_t* rowDataSizes, unsigned int rowCount, uint8_t* PSD_RESTRICT dest, unsigned int rowSize, Executor* executor)
+	{
+		PSD_ASSERT_NOT_NULL(src);
+		PSD_ASSERT_NOT_NULL(rowDataSizes);
+		PSD_ASSERT_NOT_NULL(dest);
 
-				bytesRead += count;
+		const uint64_t size = static_cast<uint64_t>(rowCount) * rowSize;
+		uint64_t taskCount = executor ? (size / MIN_TASK_SIZE) : 1u;
+		if (taskCount > MAX_TASK_COUNT)
+		{
+			taskCount = MAX_TASK_COUNT;
+		}
+		if (taskCount > rowCount)
+		{
+			taskCount = rowCount;
+		}
+		if (taskCount == 0u)
+		{
+			taskCount = 1u;
+		}
+
+		// each range holds consecutive rows, whose compressed data is consecutive as well. every row ends on a token
+		// boundary, so a range can be decompressed in one go without looking at its individual rows.
+		RowRange ranges[MAX_TASK_COUNT];
+		unsigned int row = 0u;
+		for (unsigned int i=0; i < taskCount; ++i)
+		{
+			const unsigned int endRow = static_cast<unsigned int>((static_cast<uint64_t>(rowCount) * (i + 1u)) / taskCount);
+
+			unsigned int srcSize = 0u;
+			for (unsigned int j=row; j < endRow; ++j)
+			{
+				srcSize += rowDataSizes[j];
 			}
+
+			ranges[i].src = src;
+			ranges[i].srcSize = srcSize;
+			ranges[i].dest = dest + static_cast<size_t>(row) * rowSize;
+			ranges[i].size = (endRow - row) * rowSize;
+
+			src += srcSize;
+			row = endRow;
+		}
+
+		if (taskCount == 1u)
+		{
+			DecompressRowRange(&ranges[0]);
+			return;
+		}
+
+		// the calling thread decompresses the last range on its own instead of idling until all tasks are finished
+		Executor::Task tasks[MAX_TASK_COUNT] = {};
+		for (unsigned int i=0; i < taskCount - 1u; ++i)
+		{
+			tasks[i] = executor->Submit(&DecompressRowRange, &ranges[i]);
+		}
+
+		DecompressRowRange(&ranges[taskCount - 1u]);
+
+		for (unsigned int i=0; i < taskCount - 1u; ++i)
+		{
+			executor->Wait(tasks[i]);
 		}
 	}
 
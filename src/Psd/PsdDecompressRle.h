@@ -6,12 +6,24 @@
 
 PSD_NAMESPACE_BEGIN
 
+class Executor;
+
+
 namespace imageUtil
 {
 	/// \ingroup ImageUtil
 	/// Decompresses a block of RLE encoded data using the PackBits (http://en.wikipedia.org/wiki/PackBits) algorithm.
+	/// Never reads past \a srcSize bytes or writes past \a size bytes, bytes that cannot be decoded from malformed data are
+	/// set to zero.
 	void DecompressRle(const uint8_t* PSD_RESTRICT src, unsigned int srcSize, uint8_t* PSD_RESTRICT dest, unsigned int size);
 
+	/// \ingroup ImageUtil
+	/// Decompresses \a rowCount rows of RLE encoded data stored back-to-back, each expanding to \a rowSize bytes.
+	/// \a rowDataSizes holds the compressed size of each row, as stored in the file. Because rows are encoded independently,
+	/// the rows are split into ranges that are decompressed as separate tasks of the given \a executor, each one writing
+	/// straight into its own part of \a dest. If no executor is given, all rows are decompressed on the calling thread.
+	void DecompressRleRows(const uint8_t* PSD_RESTRICT src, const uint16_t* rowDataSizes, unsigned int rowCount, uint8_t* PSD_RESTRICT dest, unsigned int rowSize, Executor* executor);
+
 	/// \ingroup ImageUtil
 	/// Compresses a block of data to RLE encoded data using the PackBits (http://en.wikipedia.org/wiki/PackBits) algorithm.
 	/// \a dest must hold \a size * 2 bytes.
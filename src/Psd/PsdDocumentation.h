@@ -72,7 +72,7 @@
 
 
 /// \defgroup Interfaces
-/// \brief Contains abstract class interfaces that provide hooks for memory management and file I/O.
+/// \brief Contains abstract class interfaces that provide hooks for memory management, file I/O, and concurrency.
 
 
 /// \defgroup Allocators
@@ -83,6 +83,10 @@
 /// \brief Contains file interfaces and implementations that provide hooks for customized file I/O.
 
 
+/// \defgroup Executors
+/// \brief Contains executor interfaces and implementations that provide hooks for running work concurrently.
+
+
 /// \defgroup Parser
 /// \brief Provides functions for parsing the different sections of a .PSD file.
 /// \details The functions contained in this module deal with parsing and extracting data from the different sections of
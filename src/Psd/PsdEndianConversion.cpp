@@ -0,0 +1,173 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdEndianConversion.h"
+
+#include <cstring>
+
+#if !defined(PSD_USE_SSE)
+	#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+		#define PSD_USE_SSE 1
+	#else
+		#define PSD_USE_SSE 0
+	#endif
+#endif
+
+#if !defined(PSD_USE_AVX2)
+	#if defined(__AVX2__)
+		#define PSD_USE_AVX2 1
+	#else
+		#define PSD_USE_AVX2 0
+	#endif
+#endif
+
+#if PSD_USE_SSE
+	#include <emmintrin.h>
+#endif
+
+#if PSD_USE_AVX2
+	#include <immintrin.h>
+#endif
+
+
+PSD_NAMESPACE_BEGIN
+
+namespace
+{
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	static void SwapBytes16(const T* src, T* dest, size_t count)
+	{
+		static_assert(sizeof(T) == 2, "sizeof(T) is not 2 byte.");
+
+		size_t i = 0u;
+
+#if PSD_USE_AVX2
+		const __m256i mask = _mm256_setr_epi8(
+			1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+			1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+		for (; i + 16u <= count; i += 16u)
+		{
+			const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_shuffle_epi8(value, mask));
+		}
+#endif
+
+#if PSD_USE_SSE
+		// SSE2 does not have a byte shuffle, but shifting both bytes into place is just as fast
+		for (; i + 8u <= count; i += 8u)
+		{
+			const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8)));
+		}
+#endif
+
+		// the buffers might point into file data that is not aligned to T, so values are copied in and out bytewise
+		for (; i < count; ++i)
+		{
+			T value;
+			memcpy(&value, src + i, sizeof(T));
+			value = endianUtil::BigEndianToNative(value);
+			memcpy(dest + i, &value, sizeof(T));
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	static void SwapBytes32(const T* src, T* dest, size_t count)
+	{
+		static_assert(sizeof(T) == 4, "sizeof(T) is not 4 byte.");
+
+		size_t i = 0u;
+
+#if PSD_USE_AVX2
+		const __m256i mask = _mm256_setr_epi8(
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+		for (; i + 8u <= count; i += 8u)
+		{
+			const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_shuffle_epi8(value, mask));
+		}
+#endif
+
+#if PSD_USE_SSE
+		// swap the two 16-bit halves of each value first, and the bytes of each half afterwards
+		for (; i + 4u <= count; i += 4u)
+		{
+			__m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+			value = _mm_shufflehi_epi16(value, _MM_SHUFFLE(2, 3, 0, 1));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8)));
+		}
+#endif
+
+		for (; i < count; ++i)
+		{
+			T value;
+			memcpy(&value, src + i, sizeof(T));
+			value = endianUtil::BigEndianToNative(value);
+			memcpy(dest + i, &value, sizeof(T));
+		}
+	}
+}
+
+
+namespace endianUtil
+{
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	void BigEndianToNative(const uint8_t* src, uint8_t* dest, size_t count)
+	{
+		if (src != dest)
+		{
+			memcpy(dest, src, count);
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	void BigEndianToNative(const uint16_t* src, uint16_t* dest, size_t count)
+	{
+		SwapBytes16(src, dest, count);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	void BigEndianToNative(const float32_t* src, float32_t* dest, size_t count)
+	{
+		SwapBytes32(src, dest, count);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	void NativeToBigEndian(const uint8_t* src, uint8_t* dest, size_t count)
+	{
+		BigEndianToNative(src, dest, count);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	void NativeToBigEndian(const uint16_t* src, uint16_t* dest, size_t count)
+	{
+		BigEndianToNative(src, dest, count);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	void NativeToBigEndian(const float32_t* src, float32_t* dest, size_t count)
+	{
+		BigEndianToNative(src, dest, count);
+	}
+}
+
+PSD_NAMESPACE_END
@@ -28,6 +28,31 @@ namespace endianUtil
 	/// Converts from native-endian to little-endian, and returns the converted value.
 	template <typename T>
 	PSD_INLINE T NativeToLittleEndian(T value);
+
+
+	/// Converts \a count values stored at \a src from big-endian to native-endian, and stores them at \a dest.
+	/// \a src and \a dest may point to the same buffer for converting in-place, which does nothing for 8-bit values.
+	void BigEndianToNative(const uint8_t* src, uint8_t* dest, size_t count);
+
+	/// Converts \a count values stored at \a src from big-endian to native-endian, and stores them at \a dest.
+	/// \a src and \a dest may point to the same buffer for converting in-place, and need not be aligned to the size of the values.
+	void BigEndianToNative(const uint16_t* src, uint16_t* dest, size_t count);
+
+	/// Converts \a count values stored at \a src from big-endian to native-endian, and stores them at \a dest.
+	/// \a src and \a dest may point to the same buffer for converting in-place, and need not be aligned to the size of the values.
+	void BigEndianToNative(const float32_t* src, float32_t* dest, size_t count);
+
+	/// Converts \a count values stored at \a src from native-endian to big-endian, and stores them at \a dest.
+	/// \a src and \a dest may point to the same buffer for converting in-place, which does nothing for 8-bit values.
+	void NativeToBigEndian(const uint8_t* src, uint8_t* dest, size_t count);
+
+	/// Converts \a count values stored at \a src from native-endian to big-endian, and stores them at \a dest.
+	/// \a src and \a dest may point to the same buffer for converting in-place, and need not be aligned to the size of the values.
+	void NativeToBigEndian(const uint16_t* src, uint16_t* dest, size_t count);
+
+	/// Converts \a count values stored at \a src from native-endian to big-endian, and stores them at \a dest.
+	/// \a src and \a dest may point to the same buffer for converting in-place, and need not be aligned to the size of the values.
+	void NativeToBigEndian(const float32_t* src, float32_t* dest, size_t count);
 }
 
 #include "PsdEndianConversion.inl"
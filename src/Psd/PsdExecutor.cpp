@@ -0,0 +1,39 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdExecutor.h"
+
+#include "PsdAssert.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+Executor::~Executor(void)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+Executor::Task Executor::Submit(TaskFunction function, void* data)
+{
+	PSD_ASSERT_NOT_NULL(function);
+
+	return DoSubmit(function, data);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void Executor::Wait(Task& task)
+{
+	PSD_ASSERT_NOT_NULL(task);
+
+	DoWait(task);
+	task = nullptr;
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,43 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Interfaces
+/// \ingroup Executors
+/// \brief Base class for all executors.
+/// \details Executors are used by the library to run independent pieces of work concurrently, e.g. parsing different
+/// sections of a document at the same time. This allows integrating the library with an application's own job system
+/// instead of having the library create threads on its own.
+/// \remark Similar to asynchronous file reads, each submitted task must be used in a call to Wait() in order to free resources
+/// associated with it. Implementations must make sure that waiting for a task from within another task cannot deadlock,
+/// e.g. by running the task on the waiting thread if it has not been started yet.
+/// \sa ThreadPool
+class Executor
+{
+public:
+	/// A function carried out by a task, being handed the data given to Submit().
+	typedef void (*TaskFunction)(void* data);
+
+	/// A type representing an object associated with a submitted task.
+	typedef void* Task;
+
+	/// Empty destructor.
+	virtual ~Executor(void);
+
+	/// Submits a task that calls \a function with the given \a data, which is carried out at some point before the returned
+	/// Task has been waited for.
+	Task Submit(TaskFunction function, void* data);
+
+	/// Waits until the task associated with the given object is finished, and deletes its internal resources.
+	void Wait(Task& task);
+
+private:
+	virtual Task DoSubmit(TaskFunction function, void* data) PSD_ABSTRACT;
+	virtual void DoWait(Task& task) PSD_ABSTRACT;
+};
+
+PSD_NAMESPACE_END
@@ -298,6 +298,31 @@ namespace
 	}
 
 
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static uint32_t GetImageResourcesSectionLength(ExportDocument* document)
+	{
+		// the image resources section holds optional XMP meta data, ICC profile, EXIF data, thumbnail, and alpha channel
+		// information. each resource is padded to a multiple of 2.
+		const bool hasMetaData = (document->attributeCount != 0u);
+		const bool hasIccProfile = (document->iccProfile != nullptr);
+		const bool hasExifData = (document->exifData != nullptr);
+		const bool hasThumbnail = (document->thumbnail != nullptr);
+		const bool hasAlphaChannels = (document->alphaChannelCount != 0u);
+
+		uint32_t sectionLength = 0u;
+		sectionLength += hasMetaData ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + GetMetaDataResourceSize(document), 2u) : 0u;
+		sectionLength += hasIccProfile ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + GetIccProfileResourceSize(document), 2u) : 0u;
+		sectionLength += hasExifData ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + GetExifDataResourceSize(document), 2u) : 0u;
+		sectionLength += hasThumbnail ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + GetThumbnailResourceSize(document), 2u) : 0u;
+		sectionLength += hasAlphaChannels ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + GetDisplayInfoResourceSize(document), 2u) : 0u;
+		sectionLength += hasAlphaChannels ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + GetChannelNamesResourceSize(document), 2u) : 0u;
+		sectionLength += hasAlphaChannels ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + GetUnicodeChannelNamesResourceSize(document), 2u) : 0u;
+
+		return sectionLength;
+	}
+
+
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
 	static void WriteImageResource(SyncFileWriter& writer, uint16_t id, uint32_t resourceSize)
@@ -498,10 +523,7 @@ static void CreateDataRaw(Allocator* allocator, ExportLayer* layer, unsigned int
 	const uint32_t size = width*height;
 
 	T* bigEndianData = memoryUtil::AllocateArray<T>(allocator, size);
-	for (unsigned int i = 0u; i < size; ++i)
-	{
-		bigEndianData[i] = endianUtil::NativeToBigEndian(planarData[i]);
-	}
+	endianUtil::NativeToBigEndian(planarData, bigEndianData, size);
 
 	layer->channelData[channelIndex] = bigEndianData;
 	layer->channelSize[channelIndex] = size*sizeof(T);
@@ -524,10 +546,7 @@ static void CreateDataRLE(Allocator* allocator, ExportLayer* layer, unsigned int
 	unsigned int offset = 0u;
 	for (unsigned int y = 0u; y < height; ++y)
 	{
-		for (unsigned int x = 0u; x < width; ++x)
-		{
-			bigEndianRowData[x] = endianUtil::NativeToBigEndian(planarData[y*width + x]);
-		}
+		endianUtil::NativeToBigEndian(planarData + y*width, bigEndianRowData, width);
 
 		const unsigned int compressedSize = imageUtil::CompressRle(reinterpret_cast<const uint8_t*>(bigEndianRowData), rleRowData, width*sizeof(T));
 		PSD_ASSERT(compressedSize <= width*sizeof(T) * 2u, "RLE compressed data doesn't fit into provided buffer.");
@@ -572,10 +591,7 @@ static void CreateDataZipPrediction(Allocator* allocator, ExportLayer* layer, un
 	}
 
 	// convert to big endian
-	for (unsigned int i = 0u; i < size; ++i)
-	{
-		allocation[i] = endianUtil::NativeToBigEndian(allocation[i]);
-	}
+	endianUtil::NativeToBigEndian(allocation, allocation, size);
 
 	size_t zipDataSize = 0u;
 	void* zipData = tdefl_compress_mem_to_heap(allocation, size*sizeof(T), &zipDataSize, TDEFL_WRITE_ZLIB_HEADER);
@@ -645,10 +661,7 @@ static void CreateDataZip(Allocator* allocator, ExportLayer* layer, unsigned int
 	const uint32_t size = width*height;
 
 	T* bigEndianData = memoryUtil::AllocateArray<T>(allocator, size);
-	for (unsigned int i = 0u; i < size; ++i)
-	{
-		bigEndianData[i] = endianUtil::NativeToBigEndian(planarData[i]);
-	}
+	endianUtil::NativeToBigEndian(planarData, bigEndianData, size);
 
 	size_t zipDataSize = 0u;
 	void* zipData = tdefl_compress_mem_to_heap(bigEndianData, size*sizeof(T), &zipDataSize, TDEFL_WRITE_ZLIB_HEADER);
@@ -802,10 +815,7 @@ void UpdateChannelImpl(ExportDocument* document, Allocator* allocator, unsigned
 	// copy raw data
 	const uint32_t size = document->width*document->height;
 	T* channelData = memoryUtil::AllocateArray<T>(allocator, size);
-	for (unsigned int i = 0u; i < size; ++i)
-	{
-		channelData[i] = endianUtil::NativeToBigEndian(data[i]);
-	}
+	endianUtil::NativeToBigEndian(data, channelData, size);
 	document->alphaChannelData[channelIndex] = channelData;
 }
 
@@ -849,12 +859,9 @@ void UpdateMergedImageImpl(ExportDocument* document, Allocator* allocator, const
 	T* memoryR = memoryUtil::AllocateArray<T>(allocator, size);
 	T* memoryG = memoryUtil::AllocateArray<T>(allocator, size);
 	T* memoryB = memoryUtil::AllocateArray<T>(allocator, size);
-	for (unsigned int i = 0u; i < size; ++i)
-	{
-		memoryR[i] = endianUtil::NativeToBigEndian(planarDataR[i]);
-		memoryG[i] = endianUtil::NativeToBigEndian(planarDataG[i]);
-		memoryB[i] = endianUtil::NativeToBigEndian(planarDataB[i]);
-	}
+	endianUtil::NativeToBigEndian(planarDataR, memoryR, size);
+	endianUtil::NativeToBigEndian(planarDataG, memoryG, size);
+	endianUtil::NativeToBigEndian(planarDataB, memoryB, size);
 	document->mergedImageData[0] = memoryR;
 	document->mergedImageData[1] = memoryG;
 	document->mergedImageData[2] = memoryB;
@@ -885,11 +892,64 @@ void UpdateMergedImage(ExportDocument* document, Allocator* allocator, const flo
 }
 
 
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t ComputeExportedSize(ExportDocument* document)
+{
+	PSD_ASSERT_NOT_NULL(document);
+
+	// header: signature, version, reserved bytes, channel count, height, width, bits per channel, color mode
+	uint64_t size = 4u + 2u + 6u + 2u + 4u + 4u + 2u + 2u;
+
+	// color mode data section, only holding magic HDR info in 32-bit mode
+	size += 4u;
+	if (document->bitsPerChannel == 32u)
+	{
+		size += 112u;
+	}
+
+	// image resources section
+	size += 4u + GetImageResourcesSectionLength(document);
+
+	// layer mask section. 16-bit and 32-bit layer data is stored in Additional Layer Information, following an empty layer
+	// info section and an empty global layer mask info.
+	const uint32_t layerInfoSectionLength = bitUtil::RoundUpToMultiple(GetLayerInfoSectionLength(document), 4u);
+	size += 4u;
+	if (document->bitsPerChannel != 8u)
+	{
+		size += 4u + 4u + 4u + 4u;
+	}
+	size += layerInfoSectionLength;
+
+	// global layer mask info
+	size += 4u;
+
+	// merged data section, always stored uncompressed
+	const uint64_t channelSize = static_cast<uint64_t>(document->width * document->height * document->bitsPerChannel / 8u);
+	size += 2u;
+	if (document->colorMode == exportColorMode::GRAYSCALE)
+	{
+		size += channelSize;
+	}
+	else if (document->colorMode == exportColorMode::RGB)
+	{
+		size += channelSize * 3u;
+	}
+	size += channelSize * document->alphaChannelCount;
+
+	return size;
+}
+
+
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 {
-	SyncFileWriter writer(file);
+	// reserving the whole file up front avoids fragmentation and repeated metadata updates while the file grows.
+	// not all files support this, in which case the file simply grows while writing.
+	file->Preallocate(ComputeExportedSize(document));
+
+	SyncFileWriter writer(file, allocator, SyncFileWriter::DEFAULT_STAGING_SIZE);
 
 	// signature
 	fileUtil::WriteToFileBE(writer, util::Key<'8', 'B', 'P', 'S'>::VALUE);
@@ -998,16 +1058,8 @@ void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 			const uint32_t channelNamesSize = hasAlphaChannels ? GetChannelNamesResourceSize(document) : 0u;
 			const uint32_t unicodeChannelNamesSize = hasAlphaChannels ? GetUnicodeChannelNamesResourceSize(document) : 0u;
 
-			uint32_t sectionLength = 0u;
-			sectionLength += hasMetaData ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + metaDataSize, 2u) : 0u;
-			sectionLength += hasIccProfile ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + iccProfileSize, 2u) : 0u;
-			sectionLength += hasExifData ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + exifDataSize, 2u) : 0u;
-			sectionLength += hasThumbnail ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + thumbnailSize, 2u) : 0u;
-			sectionLength += hasAlphaChannels ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + displayInfoSize, 2u) : 0u;
-			sectionLength += hasAlphaChannels ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + channelNamesSize, 2u) : 0u;
-			sectionLength += hasAlphaChannels ? bitUtil::RoundUpToMultiple(GetImageResourceSize() + unicodeChannelNamesSize, 2u) : 0u;
-
 			// image resource section starts with length of the whole section
+			const uint32_t sectionLength = GetImageResourcesSectionLength(document);
 			fileUtil::WriteToFileBE(writer, sectionLength);
 
 			if (hasMetaData)
@@ -1043,7 +1095,7 @@ void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 
 				const uint64_t start = writer.GetPosition();
 				{
-					writer.Write(document->iccProfile, document->sizeOfICCProfile);
+					writer.WriteDeferred(document->iccProfile, document->sizeOfICCProfile);
 				}
 				const uint64_t bytesWritten = writer.GetPosition() - start;
 				if (bytesWritten & 1ull)
@@ -1059,7 +1111,7 @@ void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 
 				const uint64_t start = writer.GetPosition();
 				{
-					writer.Write(document->exifData, document->sizeOfExifData);
+					writer.WriteDeferred(document->exifData, document->sizeOfExifData);
 				}
 				const uint64_t bytesWritten = writer.GetPosition() - start;
 				if (bytesWritten & 1ull)
@@ -1090,7 +1142,7 @@ void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 					fileUtil::WriteToFileBE(writer, bitsPerPixel);
 					fileUtil::WriteToFileBE(writer, planeCount);
 
-					writer.Write(document->thumbnail->binaryJpeg, document->thumbnail->binaryJpegSize);
+					writer.WriteDeferred(document->thumbnail->binaryJpeg, document->thumbnail->binaryJpegSize);
 				}
 				const uint64_t bytesWritten = writer.GetPosition() - start;
 				if (bytesWritten & 1ull)
@@ -1295,7 +1347,8 @@ void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 		writer.Write(layer->name, paddedNameLength - 1u);
 	}
 
-	// per-layer data
+	// per-layer data. the compressed channel data is not copied, but written directly from the layer together with the
+	// surrounding compression types.
 	for (unsigned int i = 0u; i < document->layerCount; ++i)
 	{
 		ExportLayer* layer = document->layers + i;
@@ -1306,7 +1359,7 @@ void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 			if (layer->channelData[j])
 			{
 				fileUtil::WriteToFileBE(writer, layer->channelCompression[j]);
-				writer.Write(layer->channelData[j], layer->channelSize[j]);
+				writer.WriteDeferred(layer->channelData[j], layer->channelSize[j]);
 			}
 		}
 	}
@@ -1337,24 +1390,27 @@ void WriteDocument(ExportDocument* document, Allocator* allocator, File* file)
 		if (document->colorMode == exportColorMode::GRAYSCALE)
 		{
 			const void* dataGray = document->mergedImageData[0] ? document->mergedImageData[0] : emptyMemory;
-			writer.Write(dataGray, size);
+			writer.WriteDeferred(dataGray, size);
 		}
 		else if (document->colorMode == exportColorMode::RGB)
 		{
 			const void* dataR = document->mergedImageData[0] ? document->mergedImageData[0] : emptyMemory;
 			const void* dataG = document->mergedImageData[1] ? document->mergedImageData[1] : emptyMemory;
 			const void* dataB = document->mergedImageData[2] ? document->mergedImageData[2] : emptyMemory;
-			writer.Write(dataR, size);
-			writer.Write(dataG, size);
-			writer.Write(dataB, size);
+			writer.WriteDeferred(dataR, size);
+			writer.WriteDeferred(dataG, size);
+			writer.WriteDeferred(dataB, size);
 		}
 
 		// write alpha channels
 		for (unsigned int i = 0u; i < document->alphaChannelCount; ++i)
 		{
-			writer.Write(document->alphaChannelData[i], size);
+			writer.WriteDeferred(document->alphaChannelData[i], size);
 		}
 
+		// deferred writes might still reference the empty memory
+		writer.Flush();
+
 		memoryUtil::FreeArray(allocator, emptyMemory);
 	}
 }
@@ -108,6 +108,11 @@ void UpdateMergedImage(ExportDocument* document, Allocator* allocator, const uin
 void UpdateMergedImage(ExportDocument* document, Allocator* allocator, const float32_t* planarDataR, const float32_t* planarDataG, const float32_t* planarDataB);
 
 
+/// \ingroup Exporter
+/// Returns the exact number of bytes written by \ref WriteDocument for the document in its current state.
+/// This can be used for reserving space or quota before exporting.
+uint64_t ComputeExportedSize(ExportDocument* document);
+
 /// \ingroup Exporter
 /// Exports a document to the given file.
 void WriteDocument(ExportDocument* document, Allocator* allocator, File* file);
@@ -4,6 +4,8 @@
 #include "PsdPch.h"
 #include "PsdFile.h"
 #include "PsdAssert.h"
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
 
 
 PSD_NAMESPACE_BEGIN
@@ -88,6 +90,70 @@ bool File::WaitForWrite(File::WriteOperation& operation)
 }
 
 
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::ReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	PSD_ASSERT_NOT_NULL(buffer);
+
+	return DoReadSync(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::WriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	PSD_ASSERT_NOT_NULL(buffer);
+
+	return DoWriteSync(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::ReadBatch(const ReadRequest* requests, unsigned int count)
+{
+	PSD_ASSERT((requests != nullptr) || (count == 0u), "Batch of %u reads without requests.", count);
+
+	return DoReadBatch(requests, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::WriteBatch(const WriteRequest* requests, unsigned int count)
+{
+	PSD_ASSERT((requests != nullptr) || (count == 0u), "Batch of %u writes without requests.", count);
+
+	return DoWriteBatch(requests, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::Preallocate(uint64_t size)
+{
+	return DoPreallocate(size);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* File::GetSpan(uint64_t position, uint32_t count) const
+{
+	return DoGetSpan(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::Prefetch(uint64_t position, uint64_t count)
+{
+	return DoPrefetch(position, count);
+}
+
+
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 uint64_t File::GetSize(void) const
@@ -95,4 +161,105 @@ uint64_t File::GetSize(void) const
 	return DoGetSize();
 }
 
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	// do an asynchronous read and wait until it's finished
+	ReadOperation op = DoRead(buffer, count, position);
+	return DoWaitForRead(op);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::DoWriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	// do an asynchronous write and wait until it's finished
+	WriteOperation op = DoWrite(buffer, count, position);
+	return DoWaitForWrite(op);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::DoReadBatch(const ReadRequest* requests, unsigned int count)
+{
+	// issue all reads before waiting for any of them, so that they can be carried out in parallel
+	ReadOperation* operations = memoryUtil::AllocateArray<ReadOperation>(m_allocator, count);
+	for (unsigned int i=0; i < count; ++i)
+	{
+		operations[i] = DoRead(requests[i].buffer, requests[i].count, requests[i].position);
+	}
+
+	bool success = true;
+	for (unsigned int i=0; i < count; ++i)
+	{
+		// a read that could not be issued has no operation to wait for
+		if (!operations[i] || !DoWaitForRead(operations[i]))
+		{
+			success = false;
+		}
+	}
+
+	memoryUtil::FreeArray(m_allocator, operations);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::DoWriteBatch(const WriteRequest* requests, unsigned int count)
+{
+	// issue all writes before waiting for any of them, so that they can be carried out in parallel
+	WriteOperation* operations = memoryUtil::AllocateArray<WriteOperation>(m_allocator, count);
+	for (unsigned int i=0; i < count; ++i)
+	{
+		operations[i] = DoWrite(requests[i].buffer, requests[i].count, requests[i].position);
+	}
+
+	bool success = true;
+	for (unsigned int i=0; i < count; ++i)
+	{
+		// a write that could not be issued has no operation to wait for
+		if (!operations[i] || !DoWaitForWrite(operations[i]))
+		{
+			success = false;
+		}
+	}
+
+	memoryUtil::FreeArray(m_allocator, operations);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::DoPreallocate(uint64_t)
+{
+	// preallocation is not supported by default
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* File::DoGetSpan(uint64_t, uint32_t) const
+{
+	// direct access is not supported by default
+	return nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool File::DoPrefetch(uint64_t, uint64_t)
+{
+	// prefetching is not supported by default
+	return false;
+}
+
 PSD_NAMESPACE_END
@@ -16,6 +16,8 @@ class Allocator;
 /// native (platform- and OS-provided) functions for e.g. asynchronous I/O.
 /// \remark Note that the interface only offers asynchronous read operations. The reason for this is that asynchronous reads
 /// allow for parallelizing file accesses to the same file, while still being able to add synchronous reads as a wrapper on top.
+/// Implementations can additionally provide a faster path for synchronous reads and writes, which is used by \ref SyncFileReader
+/// and \ref SyncFileWriter.
 /// \sa NativeFile SyncFileReader
 class File
 {
@@ -26,6 +28,22 @@ public:
 	/// A type representing an object associated with a write operation.
 	typedef void* WriteOperation;
 
+	/// A single read that is part of a batch, see ReadBatch().
+	struct ReadRequest
+	{
+		void* buffer;
+		uint32_t count;
+		uint64_t position;
+	};
+
+	/// A single write that is part of a batch, see WriteBatch().
+	struct WriteRequest
+	{
+		const void* buffer;
+		uint32_t count;
+		uint64_t position;
+	};
+
 	/// Constructor.
 	explicit File(Allocator* allocator);
 
@@ -55,6 +73,44 @@ public:
 	/// Waits until the write operation associated with the given object is finished, and deletes its internal resources.
 	bool WaitForWrite(WriteOperation& operation);
 
+	/// Synchronously loads count bytes into the buffer, reading from position in the file, and returns whether the operation was successful.
+	/// \remark By default, this issues an asynchronous read and waits for it. Implementations that have a cheaper way of doing
+	/// synchronous reads (e.g. pread() on POSIX systems) override this to skip the asynchronous round-trip.
+	bool ReadSync(void* buffer, uint32_t count, uint64_t position);
+
+	/// Synchronously writes count bytes from the buffer, writing to position in the file, and returns whether the operation was successful.
+	/// \remark By default, this issues an asynchronous write and waits for it. Implementations that have a cheaper way of doing
+	/// synchronous writes (e.g. pwrite() on POSIX systems) override this to skip the asynchronous round-trip.
+	bool WriteSync(const void* buffer, uint32_t count, uint64_t position);
+
+	/// Synchronously carries out a batch of count reads, and returns whether all of them were successful.
+	/// \remark By default, this issues all reads asynchronously before waiting for any of them. Implementations can override
+	/// this to hand the whole batch to the OS at once, e.g. using vectored I/O for reads that directly follow each other.
+	bool ReadBatch(const ReadRequest* requests, unsigned int count);
+
+	/// Synchronously carries out a batch of count writes, and returns whether all of them were successful.
+	/// \remark By default, this issues all writes asynchronously before waiting for any of them. Implementations can override
+	/// this to hand the whole batch to the OS at once, e.g. using vectored I/O for writes that directly follow each other.
+	bool WriteBatch(const WriteRequest* requests, unsigned int count);
+
+	/// Reserves storage for size bytes, and returns whether the space could be reserved.
+	/// \remark By default, nothing is reserved and false is returned. Implementations that can allocate the space for a file
+	/// up front (e.g. using fallocate() on Linux) override this, which avoids fragmentation when writing large files.
+	bool Preallocate(uint64_t size);
+
+	/// Returns a pointer to count bytes starting at position directly inside the file's memory, or a nullptr if the file
+	/// does not offer direct access to its contents. Returned pointers stay valid until the file is closed.
+	/// \remark By default, this returns a nullptr, and callers have to fall back to ReadSync() into a buffer of their own.
+	/// Implementations that hold the whole file in memory (e.g. \ref MappedFile) override this, which allows decoders to work
+	/// on the compressed data in-place.
+	const void* GetSpan(uint64_t position, uint32_t count) const;
+
+	/// Hints that count bytes starting at position will be read soon, and returns whether the hint was passed on.
+	/// \remark By default, this does nothing and returns false. Implementations backed by the OS page cache override this
+	/// (e.g. using posix_fadvise() on Linux), so that the data can be fetched in the background while other work is done.
+	/// The hint never changes the outcome of any later read.
+	bool Prefetch(uint64_t position, uint64_t count);
+
 	/// Returns the size of the file. Calling this method is only valid on a file that has successfully been opened by a call to Open() previously.
 	/// If the function fails, 0 will be returned.
 	uint64_t GetSize(void) const;
@@ -73,6 +129,14 @@ private:
 	virtual WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_ABSTRACT;
 	virtual bool DoWaitForWrite(WriteOperation& operation) PSD_ABSTRACT;
 
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position);
+	virtual bool DoWriteSync(const void* buffer, uint32_t count, uint64_t position);
+	virtual bool DoReadBatch(const ReadRequest* requests, unsigned int count);
+	virtual bool DoWriteBatch(const WriteRequest* requests, unsigned int count);
+	virtual bool DoPreallocate(uint64_t size);
+	virtual const void* DoGetSpan(uint64_t position, uint32_t count) const;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count);
+
 	virtual uint64_t DoGetSize(void) const PSD_ABSTRACT;
 };
 
@@ -0,0 +1,572 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdFilePool.h"
+
+#include "PsdFile.h"
+#if defined(_WIN32)
+	#include "PsdNativeFile.h"
+#elif defined(__APPLE__)
+	#include "PsdNativeFile_Mac.h"
+#else
+	#include "PsdNativeFile_Linux.h"
+#endif
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAssert.h"
+#include "PsdLog.h"
+#include <mutex>
+#include <new>
+#include <cstring>
+#include <cwchar>
+
+
+PSD_NAMESPACE_BEGIN
+
+const unsigned int FilePool::DEFAULT_MAX_OPEN_FILES;
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct FilePool::Entry
+{
+	Entry* lruPrev;					// towards more recently used entries, only files without views are part of the list
+	Entry* lruNext;					// towards less recently used entries, only files without views are part of the list
+	Entry* bucketNext;
+	File* file;
+	wchar_t* filename;
+	uint64_t hash;
+	unsigned int viewCount;
+};
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct FilePool::State
+{
+	std::mutex mutex;
+
+	Entry** buckets;
+	uint64_t bucketMask;
+	Entry* lruHead;
+	Entry* lruTail;
+
+	unsigned int openCount;
+	unsigned int viewCount;
+
+	uint64_t hitCount;
+	uint64_t missCount;
+	uint64_t evictionCount;
+};
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+class FilePool::View : public File
+{
+public:
+	View(Allocator* allocator, Entry* entry);
+
+	Entry* GetEntry(void) const;
+
+private:
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoReadBatch(const ReadRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual const void* DoGetSpan(uint64_t position, uint32_t count) const PSD_OVERRIDE;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count) PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	Entry* m_entry;
+};
+
+
+namespace
+{
+	typedef std::lock_guard<std::mutex> PoolLock;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static uint64_t HashFilename(const wchar_t* filename)
+	{
+		// 64-bit FNV-1a over the characters of the name
+		uint64_t hash = 0xCBF29CE484222325ull;
+		for (const wchar_t* c = filename; *c != L'\0'; ++c)
+		{
+			hash ^= static_cast<uint64_t>(*c);
+			hash *= 0x100000001B3ull;
+		}
+
+		return hash;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename State, typename Entry>
+	static void LinkFront(State* state, Entry* entry)
+	{
+		entry->lruPrev = nullptr;
+		entry->lruNext = state->lruHead;
+		if (state->lruHead)
+		{
+			state->lruHead->lruPrev = entry;
+		}
+		else
+		{
+			state->lruTail = entry;
+		}
+
+		state->lruHead = entry;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename State, typename Entry>
+	static void Unlink(State* state, Entry* entry)
+	{
+		if (entry->lruPrev)
+		{
+			entry->lruPrev->lruNext = entry->lruNext;
+		}
+		else
+		{
+			state->lruHead = entry->lruNext;
+		}
+
+		if (entry->lruNext)
+		{
+			entry->lruNext->lruPrev = entry->lruPrev;
+		}
+		else
+		{
+			state->lruTail = entry->lruPrev;
+		}
+
+		entry->lruPrev = nullptr;
+		entry->lruNext = nullptr;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename State, typename Entry>
+	static void AddView(State* state, Entry* entry)
+	{
+		// a file that gets its first view is no longer a candidate for being closed
+		if (entry->viewCount == 0u)
+		{
+			Unlink(state, entry);
+		}
+
+		++entry->viewCount;
+		++state->viewCount;
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::View::View(Allocator* allocator, Entry* entry)
+	: File(allocator)
+	, m_entry(entry)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::Entry* FilePool::View::GetEntry(void) const
+{
+	return m_entry;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoOpenRead(const wchar_t*)
+{
+	PSD_ERROR("FilePool", "Pooled files can only be opened by the pool.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoOpenWrite(const wchar_t*)
+{
+	PSD_ERROR("FilePool", "Pooled files can only be opened by the pool.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoClose(void)
+{
+	// the file stays open until the pool closes it
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation FilePool::View::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	return m_entry->file->Read(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoWaitForRead(File::ReadOperation& operation)
+{
+	return m_entry->file->WaitForRead(operation);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation FilePool::View::DoWrite(const void*, uint32_t, uint64_t)
+{
+	PSD_ERROR("FilePool", "Pooled files cannot be written to.");
+	return nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoWaitForWrite(File::WriteOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	return m_entry->file->ReadSync(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoReadBatch(const ReadRequest* requests, unsigned int count)
+{
+	return m_entry->file->ReadBatch(requests, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* FilePool::View::DoGetSpan(uint64_t position, uint32_t count) const
+{
+	return m_entry->file->GetSpan(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool FilePool::View::DoPrefetch(uint64_t position, uint64_t count)
+{
+	return m_entry->file->Prefetch(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t FilePool::View::DoGetSize(void) const
+{
+	return m_entry->file->GetSize();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::FilePool(Allocator* allocator)
+	: m_allocator(allocator)
+	, m_state(nullptr)
+	, m_maxOpenFiles(0u)
+{
+	Initialize(DEFAULT_MAX_OPEN_FILES);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::FilePool(Allocator* allocator, unsigned int maxOpenFiles)
+	: m_allocator(allocator)
+	, m_state(nullptr)
+	, m_maxOpenFiles(0u)
+{
+	Initialize(maxOpenFiles);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::~FilePool(void)
+{
+	State* state = m_state;
+	PSD_ASSERT(state->viewCount == 0u, "%u views of pooled files have not been released.", state->viewCount);
+
+	Entry* entries = nullptr;
+	for (uint64_t i = 0u; i <= state->bucketMask; ++i)
+	{
+		Entry* entry = state->buckets[i];
+		while (entry)
+		{
+			Entry* next = entry->bucketNext;
+			entry->bucketNext = entries;
+			entries = entry;
+			entry = next;
+		}
+	}
+
+	DestroyEntries(entries);
+
+	memoryUtil::FreeArray(m_allocator, state->buckets);
+	memoryUtil::Free(m_allocator, m_state);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File* FilePool::Acquire(const wchar_t* filename)
+{
+	PSD_ASSERT_NOT_NULL(filename);
+
+	State* state = m_state;
+	const uint64_t hash = HashFilename(filename);
+
+	Entry* entry = nullptr;
+	{
+		PoolLock lock(state->mutex);
+		entry = Find(hash, filename);
+		if (entry)
+		{
+			AddView(state, entry);
+			++state->hitCount;
+		}
+	}
+
+	if (!entry)
+	{
+		// the file is opened outside of the lock, so that threads acquiring files that are already open do not have to
+		// wait for the system call.
+		void* memory = m_allocator->Allocate(sizeof(NativeFile), PSD_ALIGN_OF(NativeFile));
+		File* file = new (memory) NativeFile(m_allocator);
+		if (!file->OpenRead(filename))
+		{
+			file->~File();
+			m_allocator->Free(file);
+			return nullptr;
+		}
+
+		const size_t length = wcslen(filename);
+		Entry* opened = memoryUtil::Allocate<Entry>(m_allocator);
+		opened->lruPrev = nullptr;
+		opened->lruNext = nullptr;
+		opened->bucketNext = nullptr;
+		opened->file = file;
+		opened->filename = memoryUtil::AllocateArray<wchar_t>(m_allocator, length + 1u);
+		opened->hash = hash;
+		opened->viewCount = 0u;
+		memcpy(opened->filename, filename, (length + 1u) * sizeof(wchar_t));
+
+		Entry* evicted = nullptr;
+		{
+			PoolLock lock(state->mutex);
+			++state->missCount;
+
+			entry = Find(hash, filename);
+			if (entry)
+			{
+				// another thread opened the same file in the meantime, so ours is not needed
+				evicted = opened;
+			}
+			else
+			{
+				Entry*& bucket = state->buckets[hash & state->bucketMask];
+				opened->bucketNext = bucket;
+				bucket = opened;
+				++state->openCount;
+
+				entry = opened;
+				evicted = CollectEvictions();
+			}
+
+			AddView(state, entry);
+		}
+
+		DestroyEntries(evicted);
+	}
+
+	void* memory = m_allocator->Allocate(sizeof(View), PSD_ALIGN_OF(View));
+	return new (memory) View(m_allocator, entry);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void FilePool::Release(File*& file)
+{
+	PSD_ASSERT_NOT_NULL(file);
+
+	State* state = m_state;
+	View* view = static_cast<View*>(file);
+	Entry* entry = view->GetEntry();
+
+	Entry* evicted = nullptr;
+	{
+		PoolLock lock(state->mutex);
+		PSD_ASSERT(entry->viewCount != 0u, "File has no views left to release.");
+
+		--entry->viewCount;
+		--state->viewCount;
+		if (entry->viewCount == 0u)
+		{
+			LinkFront(state, entry);
+		}
+
+		evicted = CollectEvictions();
+	}
+
+	DestroyEntries(evicted);
+
+	view->~View();
+	m_allocator->Free(view);
+	file = nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::Statistics FilePool::GetStatistics(void) const
+{
+	State* state = m_state;
+	PoolLock lock(state->mutex);
+
+	Statistics statistics = {};
+	statistics.hitCount = state->hitCount;
+	statistics.missCount = state->missCount;
+	statistics.evictionCount = state->evictionCount;
+	statistics.openCount = state->openCount;
+	statistics.viewCount = state->viewCount;
+
+	return statistics;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void FilePool::Initialize(unsigned int maxOpenFiles)
+{
+	m_maxOpenFiles = maxOpenFiles;
+
+	// twice as many buckets as files keeps the chains short, even if the bound is exceeded temporarily
+	uint64_t bucketCount = 16u;
+	while (bucketCount < 2u * static_cast<uint64_t>(maxOpenFiles))
+	{
+		bucketCount *= 2u;
+	}
+
+	State* state = memoryUtil::Allocate<State>(m_allocator);
+	state->buckets = memoryUtil::AllocateArray<Entry*>(m_allocator, static_cast<size_t>(bucketCount));
+	memset(state->buckets, 0, static_cast<size_t>(bucketCount) * sizeof(Entry*));
+	state->bucketMask = bucketCount - 1u;
+	state->lruHead = nullptr;
+	state->lruTail = nullptr;
+	state->openCount = 0u;
+	state->viewCount = 0u;
+	state->hitCount = 0u;
+	state->missCount = 0u;
+	state->evictionCount = 0u;
+
+	m_state = state;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::Entry* FilePool::Find(uint64_t hash, const wchar_t* filename) const
+{
+	Entry* entry = m_state->buckets[hash & m_state->bucketMask];
+	while (entry)
+	{
+		if ((entry->hash == hash) && (wcscmp(entry->filename, filename) == 0))
+			return entry;
+
+		entry = entry->bucketNext;
+	}
+
+	return nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+FilePool::Entry* FilePool::CollectEvictions(void)
+{
+	// removes the least recently used files without views from the pool, and returns them as a list that can be closed
+	// after the lock has been released.
+	State* state = m_state;
+	Entry* evicted = nullptr;
+	while ((state->openCount > m_maxOpenFiles) && state->lruTail)
+	{
+		Entry* entry = state->lruTail;
+		Unlink(state, entry);
+
+		Entry** link = &state->buckets[entry->hash & state->bucketMask];
+		while (*link != entry)
+		{
+			link = &(*link)->bucketNext;
+		}
+		*link = entry->bucketNext;
+
+		entry->bucketNext = evicted;
+		evicted = entry;
+
+		--state->openCount;
+		++state->evictionCount;
+	}
+
+	return evicted;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void FilePool::DestroyEntries(Entry* entries)
+{
+	while (entries)
+	{
+		Entry* next = entries->bucketNext;
+
+		File* file = entries->file;
+		file->Close();
+		file->~File();
+		m_allocator->Free(file);
+
+		memoryUtil::FreeArray(m_allocator, entries->filename);
+		memoryUtil::Free(m_allocator, entries);
+
+		entries = next;
+	}
+}
+
+PSD_NAMESPACE_END
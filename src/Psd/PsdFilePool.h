@@ -0,0 +1,81 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+class Allocator;
+class File;
+
+
+/// \ingroup Files
+/// \brief A bounded pool of files opened for reading, meant for batch jobs that visit the same files several times.
+/// \details Files are keyed by their name. The first \ref Acquire of a file opens it as a \ref NativeFile, and every later
+/// one hands out another view on the already opened file, without any system call or filename conversion. Views forward
+/// all reads to the shared file, whose positional reads are thread-safe, so each thread can use a view of its own.
+///
+/// Files without any outstanding views stay open, and are closed in least recently used order as soon as more than
+/// the given maximum number of files is open. Files that still have views are never closed, so the bound can be
+/// exceeded temporarily while more files than that are in use at the same time.
+/// \remark Views can only be read from. Calling \ref File::Close on a view does nothing, it has to be handed back using
+/// \ref Release instead.
+/// \remark Files and views are allocated and freed using the given allocator from whichever thread acquires or releases them,
+/// so the allocator must be thread-safe if the pool is shared between threads.
+/// \sa NativeFile
+class FilePool
+{
+public:
+	/// Pool statistics, see GetStatistics().
+	struct Statistics
+	{
+		uint64_t hitCount;			///< Number of views handed out for a file that was already open.
+		uint64_t missCount;			///< Number of views that needed the file to be opened.
+		uint64_t evictionCount;		///< Number of files closed to stay within the maximum number of open files.
+		unsigned int openCount;		///< Number of files currently open.
+		unsigned int viewCount;		///< Number of views currently handed out.
+	};
+
+	/// Default maximum number of open files.
+	static const unsigned int DEFAULT_MAX_OPEN_FILES = 64u;
+
+	/// Constructor keeping up to \ref DEFAULT_MAX_OPEN_FILES files open.
+	explicit FilePool(Allocator* allocator);
+
+	/// Constructor keeping up to \a maxOpenFiles files open.
+	FilePool(Allocator* allocator, unsigned int maxOpenFiles);
+
+	/// Destructor closing all files. All views must have been released before.
+	~FilePool(void);
+
+	/// Returns a view for reading the file with the given name, opening the file if needed, or a nullptr if the file
+	/// cannot be opened. The view must be handed back by a call to Release().
+	File* Acquire(const wchar_t* filename);
+
+	/// Hands back and nullifies a view previously returned by Acquire().
+	void Release(File*& file);
+
+	/// Returns the statistics gathered so far.
+	Statistics GetStatistics(void) const;
+
+private:
+	struct Entry;
+	struct State;
+	class View;
+
+	// the open files are owned by the pool, hence it cannot be copied
+	FilePool(const FilePool&);
+	FilePool& operator=(const FilePool&);
+
+	void Initialize(unsigned int maxOpenFiles);
+	Entry* Find(uint64_t hash, const wchar_t* filename) const;
+	Entry* CollectEvictions(void);
+	void DestroyEntries(Entry* entries);
+
+	Allocator* m_allocator;
+	State* m_state;
+	unsigned int m_maxOpenFiles;
+};
+
+PSD_NAMESPACE_END
@@ -0,0 +1,485 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdInstrumentedFile.h"
+
+#include "PsdDocument.h"
+#include "PsdLayerMaskSection.h"
+#include "PsdLayer.h"
+#include "PsdChannel.h"
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAssert.h"
+#include <atomic>
+#include <chrono>
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct InstrumentedFile::Counters
+{
+	struct OperationCounters
+	{
+		std::atomic<uint64_t> callCount;
+		std::atomic<uint64_t> requestCount;
+		std::atomic<uint64_t> byteCount;
+		std::atomic<uint64_t> totalLatency;
+		std::atomic<uint64_t> sizeHistogram[SIZE_BUCKET_COUNT];
+		std::atomic<uint64_t> latencyHistogram[LATENCY_BUCKET_COUNT];
+	};
+
+	OperationCounters reads[fileSection::COUNT];
+	OperationCounters writes[fileSection::COUNT];
+
+	// start of each section following the header, in the order of fileSection::Enum. sections can be set while other
+	// threads issue requests.
+	std::atomic<uint64_t> sectionStart[fileSection::COUNT];
+};
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct InstrumentedFile::Operation
+{
+	void* operation;
+	uint64_t start;
+	uint64_t position;
+};
+
+
+namespace
+{
+	static const uint64_t UNKNOWN_SECTION_START = ~0ull;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static uint64_t GetTimestamp(void)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static unsigned int GetBucket(uint64_t value, unsigned int bucketCount)
+	{
+		// index of the highest set bit, clamped to the last bucket
+		unsigned int bucket = 0u;
+		while ((value >>= 1u) != 0u)
+		{
+			++bucket;
+		}
+
+		return (bucket < bucketCount) ? bucket : (bucketCount - 1u);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	static void Increment(std::atomic<T>& counter, T value)
+	{
+		counter.fetch_add(value, std::memory_order_relaxed);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	static T Load(const std::atomic<T>& counter)
+	{
+		return counter.load(std::memory_order_relaxed);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename OperationCounters>
+	static void Reset(OperationCounters& operation)
+	{
+		operation.callCount.store(0u, std::memory_order_relaxed);
+		operation.requestCount.store(0u, std::memory_order_relaxed);
+		operation.byteCount.store(0u, std::memory_order_relaxed);
+		operation.totalLatency.store(0u, std::memory_order_relaxed);
+
+		for (unsigned int i = 0u; i < InstrumentedFile::SIZE_BUCKET_COUNT; ++i)
+		{
+			operation.sizeHistogram[i].store(0u, std::memory_order_relaxed);
+		}
+
+		for (unsigned int i = 0u; i < InstrumentedFile::LATENCY_BUCKET_COUNT; ++i)
+		{
+			operation.latencyHistogram[i].store(0u, std::memory_order_relaxed);
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename OperationCounters>
+	static void Copy(const OperationCounters& operation, InstrumentedFile::OperationStatistics& statistics)
+	{
+		statistics.callCount = Load(operation.callCount);
+		statistics.requestCount = Load(operation.requestCount);
+		statistics.byteCount = Load(operation.byteCount);
+		statistics.totalLatency = Load(operation.totalLatency);
+
+		for (unsigned int i = 0u; i < InstrumentedFile::SIZE_BUCKET_COUNT; ++i)
+		{
+			statistics.sizeHistogram[i] = Load(operation.sizeHistogram[i]);
+		}
+
+		for (unsigned int i = 0u; i < InstrumentedFile::LATENCY_BUCKET_COUNT; ++i)
+		{
+			statistics.latencyHistogram[i] = Load(operation.latencyHistogram[i]);
+		}
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+InstrumentedFile::InstrumentedFile(Allocator* allocator, File* file)
+	: File(allocator)
+	, m_file(file)
+	, m_counters(nullptr)
+{
+	m_counters = memoryUtil::Allocate<Counters>(m_allocator);
+	ResetStatistics();
+
+	// until the document is known, everything belongs to the header
+	m_counters->sectionStart[fileSection::HEADER].store(0u, std::memory_order_relaxed);
+	for (unsigned int i = fileSection::IMAGE_RESOURCES; i < fileSection::COUNT; ++i)
+	{
+		m_counters->sectionStart[i].store(UNKNOWN_SECTION_START, std::memory_order_relaxed);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+InstrumentedFile::~InstrumentedFile(void)
+{
+	memoryUtil::Free(m_allocator, m_counters);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void InstrumentedFile::SetDocument(const Document* document)
+{
+	// the length of a section is stored in the 4 bytes preceding it, and is read as part of that section
+	m_counters->sectionStart[fileSection::IMAGE_RESOURCES].store(document->imageResourcesSection.offset - 4u, std::memory_order_relaxed);
+	m_counters->sectionStart[fileSection::LAYER_RECORDS].store(document->layerMaskInfoSection.offset - 4u, std::memory_order_relaxed);
+	m_counters->sectionStart[fileSection::MERGED_IMAGE].store(document->imageDataSection.offset, std::memory_order_relaxed);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void InstrumentedFile::SetLayerMaskSection(const LayerMaskSection* section)
+{
+	// channel data of all layers directly follows the layer records, starting with the first channel of the first layer
+	uint64_t channelDataStart = UNKNOWN_SECTION_START;
+	for (unsigned int i = 0u; i < section->layerCount; ++i)
+	{
+		const Layer* layer = &section->layers[i];
+		for (unsigned int j = 0u; j < layer->channelCount; ++j)
+		{
+			if (layer->channels[j].fileOffset < channelDataStart)
+			{
+				channelDataStart = layer->channels[j].fileOffset;
+			}
+		}
+	}
+
+	m_counters->sectionStart[fileSection::CHANNEL_DATA].store(channelDataStart, std::memory_order_relaxed);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+InstrumentedFile::Statistics InstrumentedFile::GetStatistics(void) const
+{
+	Statistics statistics;
+	for (unsigned int i = 0u; i < fileSection::COUNT; ++i)
+	{
+		Copy(m_counters->reads[i], statistics.reads[i]);
+		Copy(m_counters->writes[i], statistics.writes[i]);
+	}
+
+	return statistics;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void InstrumentedFile::ResetStatistics(void)
+{
+	for (unsigned int i = 0u; i < fileSection::COUNT; ++i)
+	{
+		Reset(m_counters->reads[i]);
+		Reset(m_counters->writes[i]);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+fileSection::Enum InstrumentedFile::GetSection(uint64_t position) const
+{
+	// sections are stored in file order, and the start of sections that are not known yet is never reached
+	for (unsigned int i = fileSection::COUNT - 1u; i > fileSection::HEADER; --i)
+	{
+		if (position >= Load(m_counters->sectionStart[i]))
+			return static_cast<fileSection::Enum>(i);
+	}
+
+	return fileSection::HEADER;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void InstrumentedFile::RecordRequest(bool isWrite, uint64_t position, uint32_t count) const
+{
+	const fileSection::Enum section = GetSection(position);
+	Counters::OperationCounters& operation = isWrite ? m_counters->writes[section] : m_counters->reads[section];
+
+	Increment(operation.requestCount, uint64_t(1u));
+	Increment(operation.byteCount, uint64_t(count));
+	Increment(operation.sizeHistogram[GetBucket(count, SIZE_BUCKET_COUNT)], uint64_t(1u));
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void InstrumentedFile::RecordCall(bool isWrite, uint64_t position, uint64_t latency) const
+{
+	const fileSection::Enum section = GetSection(position);
+	Counters::OperationCounters& operation = isWrite ? m_counters->writes[section] : m_counters->reads[section];
+
+	Increment(operation.callCount, uint64_t(1u));
+	Increment(operation.totalLatency, latency);
+	Increment(operation.latencyHistogram[GetBucket(latency, LATENCY_BUCKET_COUNT)], uint64_t(1u));
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoOpenRead(const wchar_t* filename)
+{
+	return m_file->OpenRead(filename);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoOpenWrite(const wchar_t* filename)
+{
+	return m_file->OpenWrite(filename);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoClose(void)
+{
+	return m_file->Close();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation InstrumentedFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	RecordRequest(false, position, count);
+
+	// the latency of an asynchronous read spans from issuing it to having waited for it
+	Operation* operation = memoryUtil::Allocate<Operation>(m_allocator);
+	operation->start = GetTimestamp();
+	operation->position = position;
+	operation->operation = m_file->Read(buffer, count, position);
+
+	// a read that could not be issued is recorded right away, and has no operation to wait for
+	if (!operation->operation)
+	{
+		RecordCall(false, position, GetTimestamp() - operation->start);
+		memoryUtil::Free(m_allocator, operation);
+		return nullptr;
+	}
+
+	return operation;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoWaitForRead(File::ReadOperation& readOperation)
+{
+	Operation* operation = static_cast<Operation*>(readOperation);
+	if (!operation)
+		return false;
+
+	const bool success = m_file->WaitForRead(operation->operation);
+	RecordCall(false, operation->position, GetTimestamp() - operation->start);
+
+	memoryUtil::Free(m_allocator, operation);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation InstrumentedFile::DoWrite(const void* buffer, uint32_t count, uint64_t position)
+{
+	RecordRequest(true, position, count);
+
+	Operation* operation = memoryUtil::Allocate<Operation>(m_allocator);
+	operation->start = GetTimestamp();
+	operation->position = position;
+	operation->operation = m_file->Write(buffer, count, position);
+
+	// a write that could not be issued is recorded right away, and has no operation to wait for
+	if (!operation->operation)
+	{
+		RecordCall(true, position, GetTimestamp() - operation->start);
+		memoryUtil::Free(m_allocator, operation);
+		return nullptr;
+	}
+
+	return operation;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoWaitForWrite(File::WriteOperation& writeOperation)
+{
+	Operation* operation = static_cast<Operation*>(writeOperation);
+	if (!operation)
+		return false;
+
+	const bool success = m_file->WaitForWrite(operation->operation);
+	RecordCall(true, operation->position, GetTimestamp() - operation->start);
+
+	memoryUtil::Free(m_allocator, operation);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	RecordRequest(false, position, count);
+
+	const uint64_t start = GetTimestamp();
+	const bool success = m_file->ReadSync(buffer, count, position);
+	RecordCall(false, position, GetTimestamp() - start);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoWriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	RecordRequest(true, position, count);
+
+	const uint64_t start = GetTimestamp();
+	const bool success = m_file->WriteSync(buffer, count, position);
+	RecordCall(true, position, GetTimestamp() - start);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoReadBatch(const ReadRequest* requests, unsigned int count)
+{
+	if (count == 0u)
+		return true;
+
+	for (unsigned int i = 0u; i < count; ++i)
+	{
+		RecordRequest(false, requests[i].position, requests[i].count);
+	}
+
+	const uint64_t start = GetTimestamp();
+	const bool success = m_file->ReadBatch(requests, count);
+	RecordCall(false, requests[0].position, GetTimestamp() - start);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoWriteBatch(const WriteRequest* requests, unsigned int count)
+{
+	if (count == 0u)
+		return true;
+
+	for (unsigned int i = 0u; i < count; ++i)
+	{
+		RecordRequest(true, requests[i].position, requests[i].count);
+	}
+
+	const uint64_t start = GetTimestamp();
+	const bool success = m_file->WriteBatch(requests, count);
+	RecordCall(true, requests[0].position, GetTimestamp() - start);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoPreallocate(uint64_t size)
+{
+	return m_file->Preallocate(size);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool InstrumentedFile::DoPrefetch(uint64_t position, uint64_t count)
+{
+	return m_file->Prefetch(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* InstrumentedFile::DoGetSpan(uint64_t position, uint32_t count) const
+{
+	// data accessed through a span is never read from the file, so only successful accesses count as a request
+	const uint64_t start = GetTimestamp();
+	const void* span = m_file->GetSpan(position, count);
+	if (span)
+	{
+		RecordRequest(false, position, count);
+		RecordCall(false, position, GetTimestamp() - start);
+	}
+
+	return span;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t InstrumentedFile::DoGetSize(void) const
+{
+	return m_file->GetSize();
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,135 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+struct Document;
+struct LayerMaskSection;
+
+
+/// \ingroup Files
+/// \namespace fileSection
+/// \brief A namespace denoting the part of a .PSD file an I/O operation belongs to, see \ref InstrumentedFile.
+namespace fileSection
+{
+	enum Enum
+	{
+		HEADER = 0,							///< File header and color mode data.
+		IMAGE_RESOURCES,					///< Image Resources section.
+		LAYER_RECORDS,						///< Layer records at the start of the Layer Mask Info section.
+		CHANNEL_DATA,						///< Channel data of all layers, and everything following it in the Layer Mask Info section.
+		MERGED_IMAGE,						///< Image Data section.
+
+		COUNT
+	};
+}
+
+
+/// \ingroup Files
+/// \brief File decorator that records statistics about all I/O operations carried out on any other file.
+/// \details For reads and writes, the decorator counts the calls made to the wrapped file, the requests contained in them
+/// (a batch holds several requests, all other calls a single one) and their bytes. Additionally, the size of each request
+/// and the latency of each call are recorded in histograms with power-of-two buckets.
+///
+/// All statistics are broken down by \ref fileSection::Enum, which is determined from the position of a request. The
+/// boundaries of the sections become known by calling SetDocument() after \ref CreateDocument, and SetLayerMaskSection()
+/// after \ref ParseLayerMaskSection. Until then, requests are attributed to the header and the layer records, respectively.
+/// Batches and their latency are attributed to the section of their first request.
+///
+/// Counters are updated using relaxed atomic operations, and GetStatistics() merely copies them, so the decorator is cheap
+/// enough to be left enabled all the time.
+/// \remark Asynchronous operations are tracked using a small object obtained from the allocator.
+/// \sa File
+class InstrumentedFile : public File
+{
+public:
+	/// Number of buckets in a size histogram. Bucket i counts requests of [2^i, 2^(i+1)) bytes, the first bucket also counts
+	/// empty requests, and the last bucket counts all larger requests.
+	static const unsigned int SIZE_BUCKET_COUNT = 32u;
+
+	/// Number of buckets in a latency histogram. Bucket i counts calls that took [2^i, 2^(i+1)) nanoseconds, the first bucket
+	/// also counts calls that took no measurable time, and the last bucket counts all slower calls.
+	static const unsigned int LATENCY_BUCKET_COUNT = 40u;
+
+	/// Statistics of either reads or writes belonging to a single section.
+	struct OperationStatistics
+	{
+		uint64_t callCount;										///< Number of calls made to the wrapped file.
+		uint64_t requestCount;									///< Number of requests contained in those calls.
+		uint64_t byteCount;										///< Number of bytes requested.
+		uint64_t totalLatency;									///< Accumulated latency of all calls in nanoseconds.
+		uint64_t sizeHistogram[SIZE_BUCKET_COUNT];				///< Histogram of request sizes.
+		uint64_t latencyHistogram[LATENCY_BUCKET_COUNT];		///< Histogram of call latencies.
+	};
+
+	/// Statistics of all sections.
+	struct Statistics
+	{
+		OperationStatistics reads[fileSection::COUNT];			///< Read statistics, indexed by \ref fileSection::Enum.
+		OperationStatistics writes[fileSection::COUNT];			///< Write statistics, indexed by \ref fileSection::Enum.
+	};
+
+	/// Constructor wrapping the given file, which is opened and closed through the decorator.
+	InstrumentedFile(Allocator* allocator, File* file);
+
+	/// Destructor.
+	virtual ~InstrumentedFile(void);
+
+	/// Derives the boundaries of the header, image resources, layer mask info and image data sections from the given document.
+	/// \remark This can be called while other threads issue requests, which are attributed to either the old or new sections.
+	void SetDocument(const Document* document);
+
+	/// Derives the boundary between the layer records and the channel data from the given section.
+	/// \remark This can be called while other threads issue requests, which are attributed to either the old or new sections.
+	void SetLayerMaskSection(const LayerMaskSection* section);
+
+	/// Returns a snapshot of the statistics gathered so far.
+	Statistics GetStatistics(void) const;
+
+	/// Resets all statistics to zero.
+	void ResetStatistics(void);
+
+	/// Returns the section that a request starting at position belongs to.
+	fileSection::Enum GetSection(uint64_t position) const;
+
+private:
+	struct Counters;
+	struct Operation;
+
+	// the counters are owned by the file, hence it cannot be copied
+	InstrumentedFile(const InstrumentedFile&);
+	InstrumentedFile& operator=(const InstrumentedFile&);
+
+	void RecordRequest(bool isWrite, uint64_t position, uint32_t count) const;
+	void RecordCall(bool isWrite, uint64_t position, uint64_t latency) const;
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWriteSync(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoReadBatch(const ReadRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual bool DoWriteBatch(const WriteRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual bool DoPreallocate(uint64_t size) PSD_OVERRIDE;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count) PSD_OVERRIDE;
+	virtual const void* DoGetSpan(uint64_t position, uint32_t count) const PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	File* m_file;
+	Counters* m_counters;
+};
+
+PSD_NAMESPACE_END
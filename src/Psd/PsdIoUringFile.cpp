@@ -0,0 +1,548 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdIoUringFile.h"
+
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAssert.h"
+#include "PsdLog.h"
+#include "Psdinttypes.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+
+
+PSD_NAMESPACE_BEGIN
+
+namespace
+{
+	// an operation stays alive until somebody waited for it, and is referenced by its SQE/CQE via user_data
+	struct Operation
+	{
+		struct iovec iov;
+		int32_t result;
+		bool isCompleted;
+	};
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static int SetupRing(unsigned int entries, io_uring_params* params)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static int EnterRing(int ringFd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags)
+	{
+		return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	static T* OffsetPointer(void* base, uint32_t offset)
+	{
+		return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+	}
+}
+
+
+// the ring and its bookkeeping, shared by all threads issuing operations on the same file.
+// all members below the mutex are guarded by it.
+struct IoUringFile::Ring
+{
+	int fd;
+
+	void* sqMemory;
+	size_t sqMemorySize;
+	void* cqMemory;
+	size_t cqMemorySize;
+	io_uring_sqe* sqes;
+	size_t sqesSize;
+
+	unsigned int* sqHead;
+	unsigned int* sqTail;
+	unsigned int* sqArray;
+	unsigned int sqMask;
+	unsigned int sqEntries;
+
+	unsigned int* cqHead;
+	unsigned int* cqTail;
+	io_uring_cqe* cqes;
+	unsigned int cqMask;
+
+	std::mutex mutex;
+	std::condition_variable condition;
+
+	// number of SQEs that have been queued, but not yet submitted to the kernel
+	unsigned int pendingCount;
+
+	// number of SQEs that have been queued, but whose CQE has not been reaped yet
+	unsigned int inFlightCount;
+
+	// whether a thread is currently blocked inside io_uring_enter(), reaping completions for everybody
+	bool isWaiting;
+};
+
+
+namespace
+{
+	typedef std::unique_lock<std::mutex> RingLock;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Ring>
+	static void ReapCompletions(Ring* ring)
+	{
+		unsigned int head = *ring->cqHead;
+		const unsigned int tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+		while (head != tail)
+		{
+			const io_uring_cqe* cqe = &ring->cqes[head & ring->cqMask];
+			Operation* operation = reinterpret_cast<Operation*>(static_cast<uintptr_t>(cqe->user_data));
+			operation->result = cqe->res;
+			operation->isCompleted = true;
+
+			--ring->inFlightCount;
+			++head;
+		}
+
+		__atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Ring>
+	static bool IsDone(const Ring* ring, const Operation* operation)
+	{
+		// without an operation, we only wait until there is room for another one
+		if (operation)
+			return operation->isCompleted;
+
+		return ring->inFlightCount < ring->sqEntries;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Ring>
+	static bool Wait(Ring* ring, RingLock& lock, const Operation* operation)
+	{
+		ReapCompletions(ring);
+		while (!IsDone(ring, operation))
+		{
+			if (ring->isWaiting)
+			{
+				// somebody else is already blocked in the kernel, and will reap our completion as well
+				ring->condition.wait(lock);
+				continue;
+			}
+
+			// submit everything that has been queued so far, and wait for at least one completion
+			const unsigned int toSubmit = ring->pendingCount;
+			ring->pendingCount = 0u;
+			ring->isWaiting = true;
+
+			lock.unlock();
+			const int result = EnterRing(ring->fd, toSubmit, 1u, IORING_ENTER_GETEVENTS);
+			const int error = errno;
+			lock.lock();
+
+			ring->isWaiting = false;
+
+			bool success = true;
+			if (result < 0)
+			{
+				ring->pendingCount += toSubmit;
+				if ((error != EINTR) && (error != EAGAIN) && (error != EBUSY))
+				{
+					PSD_ERROR("IoUringFile", "io_uring_enter() => %s", strerror(error));
+					success = false;
+				}
+			}
+			else if (static_cast<unsigned int>(result) < toSubmit)
+			{
+				ring->pendingCount += toSubmit - static_cast<unsigned int>(result);
+			}
+
+			ReapCompletions(ring);
+			ring->condition.notify_all();
+
+			if (!success)
+				return false;
+		}
+
+		return true;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Ring>
+	static bool Queue(Ring* ring, uint8_t opcode, int fd, Operation* operation, uint64_t position)
+	{
+		RingLock lock(ring->mutex);
+
+		// never have more operations in flight than there are SQEs. this guarantees that the submission queue cannot
+		// overflow, and because the completion queue is twice as large, that no completion is ever dropped.
+		if (!Wait(ring, lock, nullptr))
+			return false;
+
+		const unsigned int tail = *ring->sqTail;
+		PSD_ASSERT(tail - __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) < ring->sqEntries, "Submission queue overflow.");
+
+		const unsigned int index = tail & ring->sqMask;
+		io_uring_sqe* sqe = &ring->sqes[index];
+		memset(sqe, 0, sizeof(io_uring_sqe));
+		sqe->opcode = opcode;
+		sqe->fd = fd;
+		sqe->addr = reinterpret_cast<uintptr_t>(&operation->iov);
+		sqe->len = 1u;
+		sqe->off = position;
+		sqe->user_data = reinterpret_cast<uintptr_t>(operation);
+		ring->sqArray[index] = index;
+
+		// publish the entry. it is only handed to the kernel once somebody waits for an operation.
+		__atomic_store_n(ring->sqTail, tail + 1u, __ATOMIC_RELEASE);
+		++ring->pendingCount;
+		++ring->inFlightCount;
+
+		return true;
+	}
+}
+
+
+const unsigned int IoUringFile::QUEUE_DEPTH;
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+IoUringFile::IoUringFile(Allocator* allocator)
+	: File(allocator)
+	, m_ring(nullptr)
+	, m_nativeFile(allocator)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+IoUringFile::~IoUringFile(void)
+{
+	CloseRing();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::UsesIoUring(void) const
+{
+	return (m_ring != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::OpenRing(void)
+{
+	io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	const int ringFd = SetupRing(QUEUE_DEPTH, &params);
+	if (ringFd < 0)
+	{
+		PSD_WARNING("IoUringFile", "io_uring_setup() => %s, falling back to NativeFile.", strerror(errno));
+		return false;
+	}
+
+	Ring* ring = memoryUtil::Allocate<Ring>(m_allocator);
+	ring->fd = ringFd;
+	ring->sqMemorySize = params.sq_off.array + params.sq_entries*sizeof(unsigned int);
+	ring->cqMemorySize = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+	ring->sqesSize = params.sq_entries*sizeof(io_uring_sqe);
+
+	// newer kernels map both rings with a single mmap() call
+	const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMapping)
+	{
+		if (ring->cqMemorySize > ring->sqMemorySize)
+			ring->sqMemorySize = ring->cqMemorySize;
+		ring->cqMemorySize = ring->sqMemorySize;
+	}
+
+	ring->sqMemory = mmap(nullptr, ring->sqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	ring->cqMemory = singleMapping ? ring->sqMemory : mmap(nullptr, ring->cqMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+	void* sqes = mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if ((ring->sqMemory == MAP_FAILED) || (ring->cqMemory == MAP_FAILED) || (sqes == MAP_FAILED))
+	{
+		PSD_WARNING("IoUringFile", "Cannot map io_uring => %s, falling back to NativeFile.", strerror(errno));
+
+		if (sqes != MAP_FAILED)
+			munmap(sqes, ring->sqesSize);
+		if (!singleMapping && (ring->cqMemory != MAP_FAILED))
+			munmap(ring->cqMemory, ring->cqMemorySize);
+		if (ring->sqMemory != MAP_FAILED)
+			munmap(ring->sqMemory, ring->sqMemorySize);
+
+		close(ringFd);
+		memoryUtil::Free(m_allocator, ring);
+		return false;
+	}
+
+	ring->sqes = static_cast<io_uring_sqe*>(sqes);
+	ring->sqHead = OffsetPointer<unsigned int>(ring->sqMemory, params.sq_off.head);
+	ring->sqTail = OffsetPointer<unsigned int>(ring->sqMemory, params.sq_off.tail);
+	ring->sqArray = OffsetPointer<unsigned int>(ring->sqMemory, params.sq_off.array);
+	ring->sqMask = *OffsetPointer<unsigned int>(ring->sqMemory, params.sq_off.ring_mask);
+	ring->sqEntries = params.sq_entries;
+
+	ring->cqHead = OffsetPointer<unsigned int>(ring->cqMemory, params.cq_off.head);
+	ring->cqTail = OffsetPointer<unsigned int>(ring->cqMemory, params.cq_off.tail);
+	ring->cqes = OffsetPointer<io_uring_cqe>(ring->cqMemory, params.cq_off.cqes);
+	ring->cqMask = *OffsetPointer<unsigned int>(ring->cqMemory, params.cq_off.ring_mask);
+
+	ring->pendingCount = 0u;
+	ring->inFlightCount = 0u;
+	ring->isWaiting = false;
+
+	m_ring = ring;
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void IoUringFile::CloseRing(void)
+{
+	if (!m_ring)
+		return;
+
+	PSD_ASSERT(m_ring->inFlightCount == 0u, "Closing a file with %u operations still in flight.", m_ring->inFlightCount);
+
+	munmap(m_ring->sqes, m_ring->sqesSize);
+	if (m_ring->cqMemory != m_ring->sqMemory)
+		munmap(m_ring->cqMemory, m_ring->cqMemorySize);
+	munmap(m_ring->sqMemory, m_ring->sqMemorySize);
+	close(m_ring->fd);
+
+	memoryUtil::Free(m_allocator, m_ring);
+	m_ring = nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoOpenRead(const wchar_t* filename)
+{
+	if (!m_nativeFile.OpenRead(filename))
+		return false;
+
+	OpenRing();
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoOpenWrite(const wchar_t* filename)
+{
+	if (!m_nativeFile.OpenWrite(filename))
+		return false;
+
+	OpenRing();
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoClose(void)
+{
+	CloseRing();
+
+	return m_nativeFile.Close();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation IoUringFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	if (!m_ring)
+		return m_nativeFile.Read(buffer, count, position);
+
+	Operation* operation = memoryUtil::Allocate<Operation>(m_allocator);
+	operation->iov.iov_base = buffer;
+	operation->iov.iov_len = count;
+	operation->result = 0;
+	operation->isCompleted = false;
+
+	if (!Queue(m_ring, IORING_OP_READV, m_nativeFile.GetDescriptor(), operation, position))
+	{
+		PSD_ERROR("IoUringFile", "Cannot queue read of %u bytes from file position %" PRIu64 ".", count, position);
+
+		// the read operation failed, so don't return a useful object here
+		memoryUtil::Free(m_allocator, operation);
+
+		return nullptr;
+	}
+
+	return static_cast<File::ReadOperation>(operation);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoWaitForRead(File::ReadOperation& operation)
+{
+	if (!m_ring)
+		return m_nativeFile.WaitForRead(operation);
+
+	Operation* uringOperation = static_cast<Operation*>(operation);
+	if (!uringOperation)
+		return false;
+
+	{
+		RingLock lock(m_ring->mutex);
+		if (!Wait(m_ring, lock, uringOperation))
+		{
+			// the kernel might still complete the operation at a later time, so we must not free it
+			return false;
+		}
+	}
+
+	const int32_t result = uringOperation->result;
+	memoryUtil::Free(m_allocator, uringOperation);
+
+	if (result < 0)
+	{
+		PSD_ERROR("IoUringFile", "Read operation failed => %s", strerror(-result));
+		return false;
+	}
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation IoUringFile::DoWrite(const void* buffer, uint32_t count, uint64_t position)
+{
+	if (!m_ring)
+		return m_nativeFile.Write(buffer, count, position);
+
+	Operation* operation = memoryUtil::Allocate<Operation>(m_allocator);
+	operation->iov.iov_base = const_cast<void*>(buffer);
+	operation->iov.iov_len = count;
+	operation->result = 0;
+	operation->isCompleted = false;
+
+	if (!Queue(m_ring, IORING_OP_WRITEV, m_nativeFile.GetDescriptor(), operation, position))
+	{
+		PSD_ERROR("IoUringFile", "Cannot queue write of %u bytes at file position %" PRIu64 ".", count, position);
+
+		// the write operation failed, so don't return a useful object here
+		memoryUtil::Free(m_allocator, operation);
+
+		return nullptr;
+	}
+
+	return static_cast<File::WriteOperation>(operation);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoWaitForWrite(File::WriteOperation& operation)
+{
+	if (!m_ring)
+		return m_nativeFile.WaitForWrite(operation);
+
+	Operation* uringOperation = static_cast<Operation*>(operation);
+	if (!uringOperation)
+		return false;
+
+	{
+		RingLock lock(m_ring->mutex);
+		if (!Wait(m_ring, lock, uringOperation))
+		{
+			// the kernel might still complete the operation at a later time, so we must not free it
+			return false;
+		}
+	}
+
+	const int32_t result = uringOperation->result;
+	const size_t count = uringOperation->iov.iov_len;
+	memoryUtil::Free(m_allocator, uringOperation);
+
+	if (result < 0)
+	{
+		PSD_ERROR("IoUringFile", "Write operation failed => %s", strerror(-result));
+		return false;
+	}
+	else if (static_cast<size_t>(result) != count)
+	{
+		PSD_ERROR("IoUringFile", "Short write, %d of %zu bytes written.", result, count);
+		return false;
+	}
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	// a single synchronous read is cheaper with pread() than with a round-trip through the ring
+	return m_nativeFile.ReadSync(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoWriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	return m_nativeFile.WriteSync(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoPreallocate(uint64_t size)
+{
+	return m_nativeFile.Preallocate(size);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool IoUringFile::DoPrefetch(uint64_t position, uint64_t count)
+{
+	return m_nativeFile.Prefetch(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t IoUringFile::DoGetSize(void) const
+{
+	return m_nativeFile.GetSize();
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,64 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+#include "PsdNativeFile_Linux.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Files
+/// \brief File implementation that uses a Linux io_uring internally.
+/// \details Read and write operations are turned into submission queue entries on a ring shared by all threads using the file.
+/// They are not handed to the kernel one by one, but submitted in a single io_uring_enter() call as soon as somebody waits for
+/// one of them. Issuing all channel reads of a layer before waiting for the first one therefore costs one system call.
+///
+/// The ring is set up using raw system calls, hence liburing is not needed. If the kernel refuses to create a ring (e.g. because
+/// it is too old, or io_uring is blocked by a seccomp filter), all operations are forwarded to a \ref NativeFile instead.
+/// \sa File NativeFile
+class IoUringFile : public File
+{
+public:
+	/// The number of submission queue entries of the ring.
+	static const unsigned int QUEUE_DEPTH = 64u;
+
+	/// Constructor.
+	explicit IoUringFile(Allocator* allocator);
+
+	/// Destructor tearing down the ring, if any.
+	virtual ~IoUringFile(void);
+
+	/// Returns whether the file uses an io_uring, or had to fall back to a \ref NativeFile.
+	/// Calling this method is only valid on a file that has successfully been opened.
+	bool UsesIoUring(void) const;
+
+private:
+	struct Ring;
+
+	bool OpenRing(void);
+	void CloseRing(void);
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWriteSync(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoPreallocate(uint64_t size) PSD_OVERRIDE;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count) PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	Ring* m_ring;
+	NativeFile m_nativeFile;
+};
+
+PSD_NAMESPACE_END
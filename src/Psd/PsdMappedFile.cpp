@@ -0,0 +1,221 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdMappedFile.h"
+
+#include "PsdAllocator.h"
+#include "PsdStringUtil.h"
+#include "PsdLog.h"
+#include "Psdinttypes.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+MappedFile::MappedFile(Allocator* allocator)
+	: File(allocator)
+	, m_data(nullptr)
+	, m_size(0ull)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+MappedFile::~MappedFile(void)
+{
+	Unmap();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void MappedFile::Unmap(void)
+{
+	if (m_data)
+	{
+		munmap(const_cast<uint8_t*>(m_data), static_cast<size_t>(m_size));
+	}
+
+	m_data = nullptr;
+	m_size = 0ull;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MappedFile::DoOpenRead(const wchar_t* filename)
+{
+	char* name = stringUtil::ConvertWString(filename, m_allocator);
+	const int fd = open(name, O_RDONLY);
+	if (fd == -1)
+	{
+		PSD_ERROR("MappedFile", "open(%s) => %s", name, strerror(errno));
+		m_allocator->Free(name);
+		return false;
+	}
+
+	m_allocator->Free(name);
+
+	struct stat info;
+	if (fstat(fd, &info) == -1)
+	{
+		PSD_ERROR("MappedFile", "fstat() => %s", strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	m_size = static_cast<uint64_t>(info.st_size);
+
+	// empty files cannot be mapped, but are valid nonetheless
+	if (m_size != 0ull)
+	{
+		void* data = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			PSD_ERROR("MappedFile", "mmap() => %s", strerror(errno));
+			m_size = 0ull;
+			close(fd);
+			return false;
+		}
+
+		m_data = static_cast<const uint8_t*>(data);
+	}
+
+	// the mapping keeps the file alive, the descriptor is not needed anymore
+	close(fd);
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MappedFile::DoOpenWrite(const wchar_t*)
+{
+	PSD_ERROR("MappedFile", "Mapped files can only be opened for reading.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MappedFile::DoClose(void)
+{
+	Unmap();
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation MappedFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	if (!DoReadSync(buffer, count, position))
+		return nullptr;
+
+	// the read has already finished, so any non-null object will do
+	return static_cast<File::ReadOperation>(buffer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MappedFile::DoWaitForRead(File::ReadOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation MappedFile::DoWrite(const void*, uint32_t, uint64_t)
+{
+	PSD_ERROR("MappedFile", "Mapped files cannot be written to.");
+	return nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MappedFile::DoWaitForWrite(File::WriteOperation&)
+{
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MappedFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	if (count == 0u)
+		return true;
+
+	const void* span = DoGetSpan(position, count);
+	if (!span)
+	{
+		PSD_ERROR("MappedFile", "Cannot read %u bytes from file position %" PRIu64 ", file size is %" PRIu64 ".", count, position, m_size);
+		return false;
+	}
+
+	memcpy(buffer, span, count);
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* MappedFile::DoGetSpan(uint64_t position, uint32_t count) const
+{
+	if (!m_data || (position > m_size) || (count > m_size - position))
+		return nullptr;
+
+	return m_data + position;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MappedFile::DoPrefetch(uint64_t position, uint64_t count)
+{
+	if (!m_data || (position >= m_size))
+		return false;
+
+	if (count > m_size - position)
+	{
+		count = m_size - position;
+	}
+
+	// madvise() needs a page-aligned address, so the range is extended to the start of its first page
+	const uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	const uint64_t offset = position % pageSize;
+	uint8_t* begin = const_cast<uint8_t*>(m_data) + position - offset;
+	if (madvise(begin, static_cast<size_t>(count + offset), MADV_WILLNEED) != 0)
+	{
+		PSD_ERROR("MappedFile", "madvise() => %s", strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t MappedFile::DoGetSize(void) const
+{
+	return m_size;
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,51 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Files
+/// \brief File implementation that maps the whole file into memory for reading.
+/// \details The file is mapped read-only using mmap(). Reads are simple memory copies that complete immediately, and
+/// \ref GetSpan hands out pointers directly into the mapping. The parsers use this to decompress RLE and ZIP data in-place,
+/// without having to copy it into a temporary buffer first.
+///
+/// Mapped files cannot be opened for writing.
+/// \sa File NativeFile
+class MappedFile : public File
+{
+public:
+	/// Constructor.
+	explicit MappedFile(Allocator* allocator);
+
+	/// Destructor unmapping the file, if still mapped.
+	virtual ~MappedFile(void);
+
+private:
+	void Unmap(void);
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual const void* DoGetSpan(uint64_t position, uint32_t count) const PSD_OVERRIDE;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count) PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	const uint8_t* m_data;
+	uint64_t m_size;
+};
+
+PSD_NAMESPACE_END
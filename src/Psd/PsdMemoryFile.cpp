@@ -0,0 +1,252 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdMemoryFile.h"
+
+#include "PsdAllocator.h"
+#include "PsdAssert.h"
+#include "PsdLog.h"
+#include "Psdinttypes.h"
+#include <cstring>
+
+
+PSD_NAMESPACE_BEGIN
+
+namespace
+{
+	static const uint64_t MIN_CAPACITY = 64u * 1024u;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+MemoryFile::MemoryFile(Allocator* allocator)
+	: File(allocator)
+	, m_data(nullptr)
+	, m_size(0ull)
+	, m_capacity(0ull)
+	, m_isWritable(true)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+MemoryFile::MemoryFile(Allocator* allocator, const void* data, uint64_t size)
+	: File(allocator)
+	, m_data(static_cast<uint8_t*>(const_cast<void*>(data)))
+	, m_size(size)
+	, m_capacity(size)
+	, m_isWritable(false)
+{
+	PSD_ASSERT((data != nullptr) || (size == 0ull), "Memory file of %" PRIu64 " bytes without data.", size);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+MemoryFile::~MemoryFile(void)
+{
+	if (m_isWritable && m_data)
+	{
+		m_allocator->Free(m_data);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* MemoryFile::GetData(void) const
+{
+	return m_data;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::Reserve(uint64_t capacity)
+{
+	if (capacity <= m_capacity)
+		return true;
+
+	// grow geometrically so that sequential writes only cause a logarithmic number of copies
+	uint64_t newCapacity = (m_capacity < MIN_CAPACITY) ? MIN_CAPACITY : m_capacity*2u;
+	if (newCapacity < capacity)
+		newCapacity = capacity;
+
+	if (newCapacity > static_cast<uint64_t>(static_cast<size_t>(-1)))
+	{
+		PSD_ERROR("MemoryFile", "Cannot grow file to %" PRIu64 " bytes.", newCapacity);
+		return false;
+	}
+
+	uint8_t* data = static_cast<uint8_t*>(m_allocator->Allocate(static_cast<size_t>(newCapacity), 16u));
+	if (!data)
+	{
+		PSD_ERROR("MemoryFile", "Cannot allocate %" PRIu64 " bytes.", newCapacity);
+		return false;
+	}
+
+	if (m_data)
+	{
+		memcpy(data, m_data, static_cast<size_t>(m_size));
+		m_allocator->Free(m_data);
+	}
+
+	m_data = data;
+	m_capacity = newCapacity;
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoOpenRead(const wchar_t*)
+{
+	PSD_ERROR("MemoryFile", "Memory files cannot be opened by name.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoOpenWrite(const wchar_t*)
+{
+	PSD_ERROR("MemoryFile", "Memory files cannot be opened by name.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoClose(void)
+{
+	// the contents must still be accessible after closing the file, so nothing is freed here
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation MemoryFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	if (!DoReadSync(buffer, count, position))
+		return nullptr;
+
+	// the read has already finished, so any non-null object will do
+	return static_cast<File::ReadOperation>(buffer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoWaitForRead(File::ReadOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation MemoryFile::DoWrite(const void* buffer, uint32_t count, uint64_t position)
+{
+	if (!DoWriteSync(buffer, count, position))
+		return nullptr;
+
+	// the write has already finished, so any non-null object will do
+	return const_cast<File::WriteOperation>(buffer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoWaitForWrite(File::WriteOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	if (count == 0u)
+		return true;
+
+	const void* span = DoGetSpan(position, count);
+	if (!span)
+	{
+		PSD_ERROR("MemoryFile", "Cannot read %u bytes from file position %" PRIu64 ", file size is %" PRIu64 ".", count, position, m_size);
+		return false;
+	}
+
+	memcpy(buffer, span, count);
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoWriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	if (!m_isWritable)
+	{
+		PSD_ERROR("MemoryFile", "Memory files wrapping caller-owned data cannot be written to.");
+		return false;
+	}
+
+	const uint64_t end = position + count;
+	if (!Reserve(end))
+		return false;
+
+	// like with ordinary files, writing past the end leaves a gap filled with zeros
+	if (position > m_size)
+	{
+		memset(m_data + m_size, 0, static_cast<size_t>(position - m_size));
+	}
+
+	memcpy(m_data + position, buffer, count);
+
+	if (end > m_size)
+	{
+		m_size = end;
+	}
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool MemoryFile::DoPreallocate(uint64_t size)
+{
+	if (!m_isWritable)
+		return false;
+
+	// only the capacity is reserved, the size of the file is left untouched
+	return Reserve(size);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* MemoryFile::DoGetSpan(uint64_t position, uint32_t count) const
+{
+	if (!m_data || (position > m_size) || (count > m_size - position))
+		return nullptr;
+
+	return m_data + position;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t MemoryFile::DoGetSize(void) const
+{
+	return m_size;
+}
+
+PSD_NAMESPACE_END
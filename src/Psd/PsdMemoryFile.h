@@ -0,0 +1,65 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Files
+/// \brief File implementation that reads from and writes to memory instead of a file on disk.
+/// \details A memory file either wraps a caller-owned buffer for reading, or owns a growable buffer for writing. In the latter
+/// case, a document can be serialized into memory using \ref WriteDocument, and the result can be accessed using GetData().
+///
+/// Memory files are open as soon as they are constructed, hence OpenRead() and OpenWrite() always fail. Reads and writes are
+/// simple memory copies that complete immediately, and \ref GetSpan hands out pointers directly into the buffer. Note that
+/// writing to a file may grow the buffer, which invalidates all pointers previously returned by GetSpan() and GetData().
+/// \sa File MappedFile
+class MemoryFile : public File
+{
+public:
+	/// Constructor creating an empty file for writing. The buffer is allocated from \a allocator, and grows as needed.
+	explicit MemoryFile(Allocator* allocator);
+
+	/// Constructor wrapping \a size bytes of caller-owned \a data for reading. The data is not copied, and must outlive the file.
+	MemoryFile(Allocator* allocator, const void* data, uint64_t size);
+
+	/// Destructor freeing the buffer, if owned by the file.
+	virtual ~MemoryFile(void);
+
+	/// Returns the file's contents. The size of the data is returned by GetSize().
+	const void* GetData(void) const;
+
+private:
+	// the buffer may be owned by the file, hence it cannot be copied
+	MemoryFile(const MemoryFile&);
+	MemoryFile& operator=(const MemoryFile&);
+
+	bool Reserve(uint64_t capacity);
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWriteSync(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoPreallocate(uint64_t size) PSD_OVERRIDE;
+	virtual const void* DoGetSpan(uint64_t position, uint32_t count) const PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	uint8_t* m_data;
+	uint64_t m_size;
+	uint64_t m_capacity;
+	bool m_isWritable;
+};
+
+PSD_NAMESPACE_END
@@ -4,6 +4,8 @@
 #include "PsdLog.h"
 #include "PsdFile.h"
 #include "PsdAllocator.h"
+#include "PsdAssert.h"
+#include "PsdBitUtil.h"
 #include "PsdNamespace.h"
 #include "PsdMemoryUtil.h"
 #include "PsdStringUtil.h"
@@ -11,10 +13,13 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <aio.h>
 
+#include <cerrno>
 #include <cstring>
 #include <cstdlib>
 #include <cwchar>
@@ -23,37 +28,150 @@
 
 namespace
 {
-	//Wait for R/W
-	namespace _Psd = PSD_NAMESPACE_NAME;
-	static bool generic_wait(aiocb *operation,_Psd::Allocator *alloc){
-		//Wait for it
-		if(aio_suspend(&operation,1,nullptr) == -1)
+	//Wait for R/W, the operation is released by the caller
+	static bool generic_wait(aiocb *operation){
+		//Wait for it, signals only interrupt the wait but not the operation
+		bool waited = true;
+		while(aio_error(operation) == EINPROGRESS)
 		{
-			PSD_ERROR("NativeFile","aio_suspend() => %s",strerror(errno));
-			_Psd::memoryUtil::Free(alloc,operation);
-			return false;
+			if(aio_suspend(&operation,1,nullptr) == -1 && errno != EINTR)
+			{
+				PSD_ERROR("NativeFile","aio_suspend() => %s",strerror(errno));
+				waited = false;
+				break;
+			}
+		}
+		//The aiocb is reused once released, so the operation must not be in flight anymore
+		if(!waited)
+		{
+			aio_cancel(operation->aio_fildes,operation);
+			while(aio_error(operation) == EINPROGRESS)
+			{
+				sched_yield();
+			}
 		}
 		//Get status
-		ssize_t ret = aio_return(operation);
 		int errcode = aio_error(operation);
+		ssize_t ret = aio_return(operation);
 
 		if(ret == -1)
 		{
 			PSD_ERROR("NativeFile","aio_error() %d => %s",errcode,strerror(errcode));
 		}
-		_Psd::memoryUtil::Free(alloc,operation);
-		return ret != -1;
+		return waited && ret != -1;
 	}
 }
 
 
 PSD_NAMESPACE_BEGIN
 
+//The aiocb must come first, operations are handed out as aiocb*
+struct NativeFile::PooledOperation
+{
+	aiocb cb;
+	uint32_t next;
+};
+
+const unsigned int NativeFile::DEFAULT_MAX_IN_FLIGHT;
+const uint32_t NativeFile::DIRECT_IO_ALIGNMENT;
+const uint32_t NativeFile::DIRECT_IO_THRESHOLD;
+const uint32_t NativeFile::DIRECT_IO_CHUNK_SIZE;
+
 NativeFile::NativeFile(Allocator *alloc):
+	NativeFile(alloc,DEFAULT_MAX_IN_FLIGHT,nativeFileFlags::NONE)
+{
+
+}
+NativeFile::NativeFile(Allocator *alloc,unsigned int maxInFlight):
+	NativeFile(alloc,maxInFlight,nativeFileFlags::NONE)
+{
+
+}
+NativeFile::NativeFile(Allocator *alloc,unsigned int maxInFlight,unsigned int flags):
 	File(alloc),
-	m_fd(-1)
+	m_fd(-1),
+	m_directFd(-1),
+	m_flags(flags),
+	m_pool(nullptr),
+	m_poolSize(maxInFlight),
+	m_poolHead(0),
+	m_poolHits(0),
+	m_poolMisses(0)
+{
+	if(maxInFlight == 0)
+	{
+		return;
+	}
+	//Chain all entries, index 0 means empty
+	m_pool = memoryUtil::AllocateArray<PooledOperation>(m_allocator,maxInFlight);
+	for(unsigned int i = 0;i < maxInFlight;++i)
+	{
+		m_pool[i].next = (i + 1 < maxInFlight) ? i + 2 : 0;
+	}
+	m_poolHead.store(1,std::memory_order_relaxed);
+}
+NativeFile::~NativeFile()
+{
+	if(m_pool)
+	{
+		memoryUtil::FreeArray(m_allocator,m_pool);
+	}
+}
+
+//Pool, a Treiber stack of indices, tagged against ABA
+
+aiocb *NativeFile::AcquireOperation()
+{
+	uint64_t head = m_poolHead.load(std::memory_order_acquire);
+	for(;;)
+	{
+		uint32_t index = static_cast<uint32_t>(head);
+		if(index == 0)
+		{
+			//Pool is empty, more operations in flight than expected
+			m_poolMisses.fetch_add(1,std::memory_order_relaxed);
+			return &memoryUtil::Allocate<PooledOperation>(m_allocator)->cb;
+		}
+		uint32_t next = __atomic_load_n(&m_pool[index - 1].next,__ATOMIC_RELAXED);
+		uint64_t newHead = (((head >> 32) + 1) << 32) | next;
+		if(m_poolHead.compare_exchange_weak(head,newHead,std::memory_order_acquire,std::memory_order_acquire))
+		{
+			m_poolHits.fetch_add(1,std::memory_order_relaxed);
+			return &m_pool[index - 1].cb;
+		}
+	}
+}
+void NativeFile::ReleaseOperation(aiocb *operation)
+{
+	PooledOperation *pooled = reinterpret_cast<PooledOperation*>(operation);
+	if(pooled < m_pool || pooled >= m_pool + m_poolSize)
+	{
+		memoryUtil::Free(m_allocator,pooled);
+		return;
+	}
+	uint32_t index = static_cast<uint32_t>(pooled - m_pool) + 1;
+	uint64_t head = m_poolHead.load(std::memory_order_relaxed);
+	uint64_t newHead;
+	do
+	{
+		__atomic_store_n(&pooled->next,static_cast<uint32_t>(head),__ATOMIC_RELAXED);
+		newHead = (((head >> 32) + 1) << 32) | index;
+	}
+	while(!m_poolHead.compare_exchange_weak(head,newHead,std::memory_order_release,std::memory_order_relaxed));
+}
+
+uint64_t NativeFile::GetPoolHitCount() const
 {
+	return m_poolHits.load(std::memory_order_relaxed);
+}
+uint64_t NativeFile::GetPoolMissCount() const
+{
+	return m_poolMisses.load(std::memory_order_relaxed);
+}
 
+int NativeFile::GetDescriptor() const
+{
+	return m_fd;
 }
 
 //Convert wchar to char and open
@@ -67,6 +185,15 @@ bool NativeFile::DoOpenRead(const wchar_t* filename)
 		m_allocator->Free(name);
 		return false;
 	}
+	if(m_flags & nativeFileFlags::DIRECT_IO)
+	{
+		//Second descriptor for bulk reads, small reads keep using the page cache
+		m_directFd = open(name,O_RDONLY | O_DIRECT);
+		if(m_directFd == -1)
+		{
+			PSD_WARNING("NativeFile","open(%s, O_DIRECT) => %s, using buffered reads",name,strerror(errno));
+		}
+	}
 	m_allocator->Free(name);
 	return true;
 }
@@ -85,6 +212,11 @@ bool NativeFile::DoOpenWrite(const wchar_t* filename){
 }
 bool NativeFile::DoClose()
 {
+	if(m_directFd != -1)
+	{
+		close(m_directFd);
+		m_directFd = -1;
+	}
 	int ret = close(m_fd);
 	m_fd = -1;
 	return ret == 0;
@@ -94,7 +226,7 @@ bool NativeFile::DoClose()
 
 File::ReadOperation NativeFile::DoRead(void* buffer, uint32_t count, uint64_t position)
 {
-	aiocb *operation = memoryUtil::Allocate<aiocb>(m_allocator);
+	aiocb *operation = AcquireOperation();
 	std::memset(operation,0,sizeof(aiocb));
 
 	operation->aio_buf = buffer;
@@ -110,14 +242,14 @@ File::ReadOperation NativeFile::DoRead(void* buffer, uint32_t count, uint64_t po
 	{
 		//Has Error
 		PSD_ERROR("NativeFile","On DoRead aio_read(m_fd:%d) => %s",m_fd,strerror(errno));
-		memoryUtil::Free(m_allocator,operation);
+		ReleaseOperation(operation);
 		return nullptr;
 	}
 	return operation;
 }
 File::ReadOperation NativeFile::DoWrite(const void* buffer, uint32_t count, uint64_t position)
 {
-	aiocb *operation = memoryUtil::Allocate<aiocb>(m_allocator);
+	aiocb *operation = AcquireOperation();
 	std::memset(operation,0,sizeof(aiocb));
 	
 	operation->aio_buf = const_cast<void*>(buffer);
@@ -133,7 +265,7 @@ File::ReadOperation NativeFile::DoWrite(const void* buffer, uint32_t count, uint
 	{
 		//Has Error
 		PSD_ERROR("NativeFile","On DoWrite aio_write(m_fd:%d) => %s",m_fd,strerror(errno));
-		memoryUtil::Free(m_allocator,operation);
+		ReleaseOperation(operation);
 		return nullptr;
 	}
 	return operation;
@@ -143,12 +275,310 @@ File::ReadOperation NativeFile::DoWrite(const void* buffer, uint32_t count, uint
 bool NativeFile::DoWaitForRead(ReadOperation &_operation)
 {
 	aiocb *operation = static_cast<aiocb*>(_operation);
-	return generic_wait(operation,m_allocator);
+	bool ret = generic_wait(operation);
+	ReleaseOperation(operation);
+	return ret;
 }
 bool NativeFile::DoWaitForWrite(ReadOperation &_operation)
 {
 	aiocb *operation = static_cast<aiocb*>(_operation);
-	return generic_wait(operation,m_allocator);
+	bool ret = generic_wait(operation);
+	ReleaseOperation(operation);
+	return ret;
+}
+
+//Synchronous Read / Write, no asio round-trip
+
+bool NativeFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	if(m_directFd != -1 && count >= DIRECT_IO_THRESHOLD)
+	{
+		ReadRequest request = { buffer, count, position };
+		return ReadDirect(&request,1,position,count);
+	}
+
+	uint8_t *dest = static_cast<uint8_t*>(buffer);
+	while(count > 0)
+	{
+		ssize_t ret = pread(m_fd,dest,count,static_cast<off_t>(position));
+		if(ret == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			PSD_ERROR("NativeFile","On DoReadSync pread(m_fd:%d) => %s",m_fd,strerror(errno));
+			return false;
+		}
+		if(ret == 0)
+		{
+			//Reached end of file, same as a short aio_read
+			break;
+		}
+		dest += ret;
+		count -= static_cast<uint32_t>(ret);
+		position += static_cast<uint64_t>(ret);
+	}
+	return true;
+}
+bool NativeFile::DoWriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	const uint8_t *src = static_cast<const uint8_t*>(buffer);
+	while(count > 0)
+	{
+		ssize_t ret = pwrite(m_fd,src,count,static_cast<off_t>(position));
+		if(ret == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			PSD_ERROR("NativeFile","On DoWriteSync pwrite(m_fd:%d) => %s",m_fd,strerror(errno));
+			return false;
+		}
+		src += ret;
+		count -= static_cast<uint32_t>(ret);
+		position += static_cast<uint64_t>(ret);
+	}
+	return true;
+}
+
+//Vectored Read, one preadv() per contiguous range of requests
+
+bool NativeFile::DoReadBatch(const ReadRequest* requests, unsigned int count)
+{
+	//Enough for all channels of a layer, longer ranges are split
+	const unsigned int MAX_IOVECS = 64u;
+	struct iovec iovecs[MAX_IOVECS];
+
+	unsigned int first = 0;
+	while(first < count)
+	{
+		//Gather requests that directly follow each other in the file
+		unsigned int iovecCount = 0;
+		uint64_t position = requests[first].position;
+		uint64_t end = position;
+		while(first + iovecCount < count && iovecCount < MAX_IOVECS && requests[first + iovecCount].position == end)
+		{
+			iovecs[iovecCount].iov_base = requests[first + iovecCount].buffer;
+			iovecs[iovecCount].iov_len = requests[first + iovecCount].count;
+			end += requests[first + iovecCount].count;
+			++iovecCount;
+		}
+		first += iovecCount;
+
+		if(m_directFd != -1 && end - position >= DIRECT_IO_THRESHOLD)
+		{
+			if(!ReadDirect(requests + first - iovecCount,iovecCount,position,end - position))
+			{
+				return false;
+			}
+			continue;
+		}
+
+		struct iovec *current = iovecs;
+		while(iovecCount > 0)
+		{
+			ssize_t ret = preadv(m_fd,current,static_cast<int>(iovecCount),static_cast<off_t>(position));
+			if(ret == -1)
+			{
+				if(errno == EINTR)
+				{
+					continue;
+				}
+				PSD_ERROR("NativeFile","On DoReadBatch preadv(m_fd:%d) => %s",m_fd,strerror(errno));
+				return false;
+			}
+			if(ret == 0)
+			{
+				//Reached end of file, same as a short aio_read
+				break;
+			}
+			position += static_cast<uint64_t>(ret);
+
+			//Skip what has been read, continue with partially filled buffers
+			size_t done = static_cast<size_t>(ret);
+			while(iovecCount > 0 && done >= current->iov_len)
+			{
+				done -= current->iov_len;
+				++current;
+				--iovecCount;
+			}
+			if(iovecCount > 0)
+			{
+				current->iov_base = static_cast<uint8_t*>(current->iov_base) + done;
+				current->iov_len -= done;
+			}
+		}
+	}
+	return true;
+}
+
+//Vectored Write, one pwritev() per contiguous range of requests
+
+bool NativeFile::DoWriteBatch(const WriteRequest* requests, unsigned int count)
+{
+	const unsigned int MAX_IOVECS = 64u;
+	struct iovec iovecs[MAX_IOVECS];
+
+	unsigned int first = 0;
+	while(first < count)
+	{
+		//Gather requests that directly follow each other in the file
+		unsigned int iovecCount = 0;
+		uint64_t position = requests[first].position;
+		uint64_t end = position;
+		while(first + iovecCount < count && iovecCount < MAX_IOVECS && requests[first + iovecCount].position == end)
+		{
+			iovecs[iovecCount].iov_base = const_cast<void*>(requests[first + iovecCount].buffer);
+			iovecs[iovecCount].iov_len = requests[first + iovecCount].count;
+			end += requests[first + iovecCount].count;
+			++iovecCount;
+		}
+		first += iovecCount;
+
+		struct iovec *current = iovecs;
+		while(iovecCount > 0)
+		{
+			ssize_t ret = pwritev(m_fd,current,static_cast<int>(iovecCount),static_cast<off_t>(position));
+			if(ret == -1)
+			{
+				if(errno == EINTR)
+				{
+					continue;
+				}
+				PSD_ERROR("NativeFile","On DoWriteBatch pwritev(m_fd:%d) => %s",m_fd,strerror(errno));
+				return false;
+			}
+			position += static_cast<uint64_t>(ret);
+
+			//Skip what has been written, continue with partially written buffers
+			size_t done = static_cast<size_t>(ret);
+			while(iovecCount > 0 && done >= current->iov_len)
+			{
+				done -= current->iov_len;
+				++current;
+				--iovecCount;
+			}
+			if(iovecCount > 0)
+			{
+				current->iov_base = static_cast<uint8_t*>(current->iov_base) + done;
+				current->iov_len -= done;
+			}
+		}
+	}
+	return true;
+}
+
+//O_DIRECT Read of a contiguous range, in aligned chunks through a staging buffer
+
+bool NativeFile::ReadDirect(const ReadRequest* requests, unsigned int count, uint64_t position, uint64_t size)
+{
+	const uint64_t end = position + size;
+	uint64_t chunkPosition = position & ~static_cast<uint64_t>(DIRECT_IO_ALIGNMENT - 1);
+
+	//The staging buffer only needs to hold the aligned range, reads smaller than a chunk are not inflated to one
+	const uint64_t alignedSize = bitUtil::RoundUpToMultiple<uint64_t>(end - chunkPosition,DIRECT_IO_ALIGNMENT);
+	const uint32_t stagingSize = alignedSize < DIRECT_IO_CHUNK_SIZE ? static_cast<uint32_t>(alignedSize) : DIRECT_IO_CHUNK_SIZE;
+	uint8_t *staging = static_cast<uint8_t*>(m_allocator->Allocate(stagingSize,DIRECT_IO_ALIGNMENT));
+
+	bool success = true;
+	unsigned int request = 0;
+	while(chunkPosition < end)
+	{
+		//Read the next chunk, a short read means end of file
+		const uint64_t remaining = bitUtil::RoundUpToMultiple<uint64_t>(end - chunkPosition,DIRECT_IO_ALIGNMENT);
+		const uint32_t chunkSize = remaining < stagingSize ? static_cast<uint32_t>(remaining) : stagingSize;
+		ssize_t ret;
+		do
+		{
+			ret = pread(m_directFd,staging,chunkSize,static_cast<off_t>(chunkPosition));
+		}
+		while(ret == -1 && errno == EINTR);
+
+		if(ret == -1)
+		{
+			PSD_ERROR("NativeFile","On ReadDirect pread(m_directFd:%d) => %s",m_directFd,strerror(errno));
+			success = false;
+			break;
+		}
+		const uint64_t chunkEnd = chunkPosition + static_cast<uint64_t>(ret);
+
+		//Scatter the chunk to all requests overlapping it
+		for(unsigned int i = request;i < count;++i)
+		{
+			const uint64_t from = requests[i].position > chunkPosition ? requests[i].position : chunkPosition;
+			const uint64_t requestEnd = requests[i].position + requests[i].count;
+			const uint64_t to = requestEnd < chunkEnd ? requestEnd : chunkEnd;
+			if(from >= chunkEnd)
+			{
+				break;
+			}
+			if(to > from)
+			{
+				std::memcpy(static_cast<uint8_t*>(requests[i].buffer) + (from - requests[i].position),staging + (from - chunkPosition),static_cast<size_t>(to - from));
+			}
+			if(requestEnd <= chunkEnd)
+			{
+				request = i + 1;
+			}
+		}
+
+		if(static_cast<uint64_t>(ret) < chunkSize)
+		{
+			//The file ended before the requested range, which leaves the rest of the requests unread
+			success = (chunkEnd >= end);
+			break;
+		}
+		chunkPosition = chunkEnd;
+	}
+
+	m_allocator->Free(staging);
+	return success;
+}
+
+//Reserve disk space up front, fails on filesystems without support
+
+bool NativeFile::DoPreallocate(uint64_t size)
+{
+	if(size == 0)
+	{
+		return true;
+	}
+	int ret;
+	do
+	{
+		ret = fallocate(m_fd,0,0,static_cast<off_t>(size));
+	}
+	while(ret == -1 && errno == EINTR);
+
+	if(ret == -1)
+	{
+		//Not supported is fine, the file grows while writing instead
+		if(errno != EOPNOTSUPP)
+		{
+			PSD_ERROR("NativeFile","On DoPreallocate fallocate(m_fd:%d) => %s",m_fd,strerror(errno));
+		}
+		return false;
+	}
+	return true;
+}
+
+//Start reading the range into the page cache in the background, the call does not wait for the data
+
+bool NativeFile::DoPrefetch(uint64_t position, uint64_t count)
+{
+	if(m_fd == -1)
+	{
+		return false;
+	}
+	const int ret = posix_fadvise(m_fd,static_cast<off_t>(position),static_cast<off_t>(count),POSIX_FADV_WILLNEED);
+	if(ret != 0)
+	{
+		PSD_ERROR("NativeFile","posix_fadvise(m_fd:%d) => %s",m_fd,strerror(ret));
+		return false;
+	}
+	return true;
 }
 
 
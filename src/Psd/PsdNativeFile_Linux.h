@@ -6,18 +6,89 @@
 #include "PsdFile.h"
 #include "PsdNamespace.h"
 
+#include <aio.h>
+#include <atomic>
+
 PSD_NAMESPACE_BEGIN
 
+/// \ingroup Files
+/// \namespace nativeFileFlags
+/// \brief A namespace holding the flags a \ref NativeFile can be opened with.
+namespace nativeFileFlags
+{
+	enum Enum
+	{
+		NONE = 0u,
+
+		/// Large reads bypass the page cache using O_DIRECT, small reads stay buffered.
+		DIRECT_IO = 1u << 0u
+	};
+}
+
+
 /// \ingroup Files
 /// \brief Simple file implementation that uses Posix asio internally.
+/// \details Synchronous reads and writes issued through \ref File::ReadSync and \ref File::WriteSync bypass asio and use
+/// pread()/pwrite() directly, which avoids the helper-thread handoff glibc uses for emulating asio.
+/// Batches of reads and writes issued through \ref File::ReadBatch and \ref File::WriteBatch are gathered into one
+/// preadv() or pwritev() call per contiguous range.
+///
+/// The aiocb objects needed for asynchronous operations are taken from a lock-free pool owned by the file. Only when more
+/// operations than the pool holds are in flight at the same time, additional ones are taken from the allocator.
+///
+/// When opened with \ref nativeFileFlags::DIRECT_IO, synchronous and batched reads of at least \ref DIRECT_IO_THRESHOLD bytes
+/// go through a second descriptor opened with O_DIRECT, so that bulk channel data read once does not evict the page cache.
+/// Such reads are carried out in aligned chunks using a staging buffer taken from the allocator. If the file system does not
+/// support O_DIRECT, all reads stay buffered.
 /// \sa File
 class NativeFile : public File
 {
 public:
+	/// Default number of pooled operations, i.e. the number of operations that can be in flight without allocating.
+	static const unsigned int DEFAULT_MAX_IN_FLIGHT = 64u;
+
 	/// Constructor.
 	explicit NativeFile(Allocator* allocator);
 
+	/// Alignment of file offsets, sizes and buffers required by O_DIRECT.
+	static const uint32_t DIRECT_IO_ALIGNMENT = 4096u;
+
+	/// Reads smaller than this stay buffered, even when using \ref nativeFileFlags::DIRECT_IO.
+	static const uint32_t DIRECT_IO_THRESHOLD = 256u * 1024u;
+
+	/// Maximum size of the staging buffer used for direct reads, and thus of each chunk read.
+	static const uint32_t DIRECT_IO_CHUNK_SIZE = 4u * 1024u * 1024u;
+
+	/// Constructor pooling \a maxInFlight operations.
+	NativeFile(Allocator* allocator, unsigned int maxInFlight);
+
+	/// Constructor pooling \a maxInFlight operations, opening files using the given \ref nativeFileFlags.
+	NativeFile(Allocator* allocator, unsigned int maxInFlight, unsigned int flags);
+
+	/// Destructor freeing the pool.
+	virtual ~NativeFile(void);
+
+	/// Returns the underlying file descriptor, or -1 if the file is not open.
+	int GetDescriptor(void) const;
+
+	/// Returns how many operations were served from the pool.
+	uint64_t GetPoolHitCount(void) const;
+
+	/// Returns how many operations had to be allocated because the pool was empty.
+	uint64_t GetPoolMissCount(void) const;
+
 private:
+	struct PooledOperation;
+
+	// the pool is owned by the file, hence it cannot be copied
+	NativeFile(const NativeFile&);
+	NativeFile& operator=(const NativeFile&);
+
+	aiocb* AcquireOperation(void);
+	void ReleaseOperation(aiocb* operation);
+
+	bool ReadDirect(const ReadRequest* requests, unsigned int count, uint64_t position, uint64_t size);
+
 	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
 	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
 	virtual bool DoClose(void) PSD_OVERRIDE;
@@ -28,9 +99,26 @@ private:
 	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
 	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
 
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWriteSync(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoReadBatch(const ReadRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual bool DoWriteBatch(const WriteRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual bool DoPreallocate(uint64_t size) PSD_OVERRIDE;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count) PSD_OVERRIDE;
+
 	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
 	
 	int m_fd;
+	int m_directFd;
+	unsigned int m_flags;
+
+	PooledOperation* m_pool;
+	unsigned int m_poolSize;
+
+	// free-list of pool indices plus one, with an ABA tag in the upper 32 bits
+	std::atomic<uint64_t> m_poolHead;
+	std::atomic<uint64_t> m_poolHits;
+	std::atomic<uint64_t> m_poolMisses;
 };
 
 
@@ -0,0 +1,196 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdOpenDocument.h"
+
+#include "PsdOpenedDocument.h"
+#include "PsdDocument.h"
+#include "PsdLayerMaskSection.h"
+#include "PsdLayer.h"
+#include "PsdExecutor.h"
+#include "PsdParseDocument.h"
+#include "PsdParseColorModeDataSection.h"
+#include "PsdParseImageResourcesSection.h"
+#include "PsdParseLayerMaskSection.h"
+#include "PsdParseImageDataSection.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAllocator.h"
+#include "PsdAssert.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+namespace
+{
+	// the data shared by all section tasks. each task only writes the section it parses.
+	struct SectionTaskData
+	{
+		OpenedDocument* openedDocument;
+		File* file;
+		Allocator* allocator;
+		Executor* executor;
+		unsigned int flags;
+	};
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void ParseColorModeData(void* data)
+	{
+		SectionTaskData* taskData = static_cast<SectionTaskData*>(data);
+		OpenedDocument* openedDocument = taskData->openedDocument;
+
+		openedDocument->colorModeDataSection = ParseColorModeDataSection(openedDocument->document, taskData->file, taskData->allocator);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void ParseImageResources(void* data)
+	{
+		SectionTaskData* taskData = static_cast<SectionTaskData*>(data);
+		OpenedDocument* openedDocument = taskData->openedDocument;
+
+		openedDocument->imageResourcesSection = ParseImageResourcesSection(openedDocument->document, taskData->file, taskData->allocator);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void ParseLayerMask(void* data)
+	{
+		SectionTaskData* taskData = static_cast<SectionTaskData*>(data);
+		OpenedDocument* openedDocument = taskData->openedDocument;
+		Allocator* allocator = taskData->allocator;
+
+		LayerMaskSection* layerMaskSection = ParseLayerMaskSection(openedDocument->document, taskData->file, allocator);
+		if (layerMaskSection && (taskData->flags & openDocumentFlags::EXTRACT_LAYERS) && (layerMaskSection->layerCount != 0u))
+		{
+			Layer** layers = memoryUtil::AllocateArray<Layer*>(allocator, layerMaskSection->layerCount);
+			for (unsigned int i=0; i < layerMaskSection->layerCount; ++i)
+			{
+				layers[i] = &layerMaskSection->layers[i];
+			}
+
+			ExtractLayers(openedDocument->document, taskData->file, allocator, layers, layerMaskSection->layerCount);
+
+			memoryUtil::FreeArray(allocator, layers);
+		}
+
+		openedDocument->layerMaskSection = layerMaskSection;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void ParseImageData(void* data)
+	{
+		SectionTaskData* taskData = static_cast<SectionTaskData*>(data);
+		OpenedDocument* openedDocument = taskData->openedDocument;
+
+		openedDocument->imageDataSection = ParseImageDataSection(openedDocument->document, taskData->file, taskData->allocator, taskData->executor);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+OpenedDocument* OpenDocument(File* file, Allocator* allocator, Executor* executor, unsigned int flags)
+{
+	PSD_ASSERT_NOT_NULL(file);
+	PSD_ASSERT_NOT_NULL(allocator);
+
+	Document* document = CreateDocument(file, allocator);
+	if (!document)
+		return nullptr;
+
+	OpenedDocument* openedDocument = memoryUtil::Allocate<OpenedDocument>(allocator);
+	openedDocument->document = document;
+	openedDocument->colorModeDataSection = nullptr;
+	openedDocument->imageResourcesSection = nullptr;
+	openedDocument->layerMaskSection = nullptr;
+	openedDocument->imageDataSection = nullptr;
+
+	// sections are ordered from the usually most to the least expensive one, so that the expensive ones are picked up
+	// by the executor first. sections that are not stored in the file are skipped.
+	Executor::TaskFunction functions[4] = {};
+	unsigned int functionCount = 0u;
+	if ((flags & openDocumentFlags::IMAGE_DATA) && (document->imageDataSection.length != 0u))
+	{
+		functions[functionCount++] = &ParseImageData;
+	}
+	if ((flags & (openDocumentFlags::LAYER_MASK | openDocumentFlags::EXTRACT_LAYERS)) && (document->layerMaskInfoSection.length != 0u))
+	{
+		functions[functionCount++] = &ParseLayerMask;
+	}
+	if ((flags & openDocumentFlags::IMAGE_RESOURCES) && (document->imageResourcesSection.length != 0u))
+	{
+		functions[functionCount++] = &ParseImageResources;
+	}
+	if ((flags & openDocumentFlags::COLOR_MODE_DATA) && (document->colorModeDataSection.length != 0u))
+	{
+		functions[functionCount++] = &ParseColorModeData;
+	}
+
+	if (functionCount == 0u)
+		return openedDocument;
+
+	SectionTaskData taskData = { openedDocument, file, allocator, executor, flags };
+	if (executor)
+	{
+		// the calling thread parses the last section on its own instead of idling until all tasks are finished
+		Executor::Task tasks[4] = {};
+		for (unsigned int i=0; i < functionCount - 1u; ++i)
+		{
+			tasks[i] = executor->Submit(functions[i], &taskData);
+		}
+
+		functions[functionCount - 1u](&taskData);
+
+		for (unsigned int i=0; i < functionCount - 1u; ++i)
+		{
+			executor->Wait(tasks[i]);
+		}
+	}
+	else
+	{
+		for (unsigned int i=0; i < functionCount; ++i)
+		{
+			functions[i](&taskData);
+		}
+	}
+
+	return openedDocument;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void CloseDocument(OpenedDocument*& document, Allocator* allocator)
+{
+	PSD_ASSERT_NOT_NULL(document);
+	PSD_ASSERT_NOT_NULL(allocator);
+
+	if (document->imageDataSection)
+	{
+		DestroyImageDataSection(document->imageDataSection, allocator);
+	}
+	if (document->layerMaskSection)
+	{
+		DestroyLayerMaskSection(document->layerMaskSection, allocator);
+	}
+	if (document->imageResourcesSection)
+	{
+		DestroyImageResourcesSection(document->imageResourcesSection, allocator);
+	}
+	if (document->colorModeDataSection)
+	{
+		DestroyColorModeDataSection(document->colorModeDataSection, allocator);
+	}
+
+	DestroyDocument(document->document, allocator);
+	memoryUtil::Free(allocator, document);
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,60 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+class File;
+class Allocator;
+class Executor;
+struct OpenedDocument;
+
+
+/// \ingroup Parser
+/// \namespace openDocumentFlags
+/// \brief A namespace holding the flags that select which sections are parsed by \ref OpenDocument.
+namespace openDocumentFlags
+{
+	enum Enum
+	{
+		NONE = 0u,
+
+		/// Parses the color mode data section.
+		COLOR_MODE_DATA = 1u << 0u,
+
+		/// Parses the image resources section.
+		IMAGE_RESOURCES = 1u << 1u,
+
+		/// Parses the layer mask section, without extracting the data of any layer.
+		LAYER_MASK = 1u << 2u,
+
+		/// Parses the layer mask section, and extracts the data of all layers using \ref ExtractLayers.
+		EXTRACT_LAYERS = 1u << 3u,
+
+		/// Parses the image data section holding the merged image.
+		IMAGE_DATA = 1u << 4u,
+
+		/// Parses all sections, and extracts the data of all layers.
+		ALL = COLOR_MODE_DATA | IMAGE_RESOURCES | EXTRACT_LAYERS | IMAGE_DATA
+	};
+}
+
+
+/// \ingroup Parser
+/// Parses the document and all sections selected by the given \ref openDocumentFlags, and returns a newly created
+/// instance that needs to be freed by a call to \ref CloseDocument, or a nullptr if the document could not be parsed.
+/// The sections are parsed concurrently as separate tasks of the given \a executor, so that opening a document takes
+/// about as long as parsing its most expensive section. The rows of the merged image are decompressed using the executor as
+/// well. If no executor is given, the sections are parsed one after another.
+/// \remark Sections are parsed from several threads at the same time, hence both the \a file and the \a allocator must be
+/// thread-safe when using an executor.
+/// \sa OpenedDocument
+OpenedDocument* OpenDocument(File* file, Allocator* allocator, Executor* executor, unsigned int flags);
+
+/// \ingroup Parser
+/// Destroys and nullifies the given \a document and all its sections previously created by a call to \ref OpenDocument.
+void CloseDocument(OpenedDocument*& document, Allocator* allocator);
+
+PSD_NAMESPACE_END
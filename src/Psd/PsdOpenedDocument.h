@@ -0,0 +1,30 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+struct Document;
+struct ColorModeDataSection;
+struct ImageResourcesSection;
+struct LayerMaskSection;
+struct ImageDataSection;
+
+
+/// \ingroup Types
+/// \class OpenedDocument
+/// \brief A struct holding a document together with all sections parsed by a call to \ref OpenDocument.
+/// \details Sections that were not requested, are not stored in the file, or could not be parsed are a nullptr.
+/// \sa OpenDocument CloseDocument
+struct OpenedDocument
+{
+	Document* document;								///< The document, holding the header and section offsets.
+	ColorModeDataSection* colorModeDataSection;		///< The color mode data section, or a nullptr.
+	ImageResourcesSection* imageResourcesSection;	///< The image resources section, or a nullptr.
+	LayerMaskSection* layerMaskSection;				///< The layer mask section, or a nullptr.
+	ImageDataSection* imageDataSection;				///< The image data section holding the merged image, or a nullptr.
+};
+
+PSD_NAMESPACE_END
@@ -21,7 +21,7 @@ PSD_NAMESPACE_BEGIN
 // ---------------------------------------------------------------------------------------------------------------------
 Document* CreateDocument(File* file, Allocator* allocator)
 {
-	SyncFileReader reader(file);
+	SyncFileReader reader(file, allocator, SyncFileReader::DEFAULT_READ_AHEAD_SIZE);
 	reader.SetPosition(0u);
 
 	// check signature, must be "8BPS"
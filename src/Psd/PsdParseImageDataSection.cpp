@@ -13,10 +13,14 @@
 #include "PsdEndianConversion.h"
 #include "PsdSyncFileReader.h"
 #include "PsdSyncFileUtil.h"
+#include "PsdStreamListener.h"
 #include "PsdMemoryUtil.h"
 #include "PsdDecompressRle.h"
+#include "PsdExecutor.h"
 #include "PsdAssert.h"
 #include "PsdLog.h"
+#include "Psdinttypes.h"
+#include <cstring>
 
 
 PSD_NAMESPACE_BEGIN
@@ -34,11 +38,52 @@ namespace
 		for (unsigned int i=0; i < channelCount; ++i)
 		{
 			T* planarData = static_cast<T*>(images[i].data);
-			for (unsigned int j=0; j < size; ++j)
-			{
-				planarData[j] = endianUtil::BigEndianToNative(planarData[j]);
-			}
+			endianUtil::BigEndianToNative(planarData, planarData, size);
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	void EndianConvertRow(void* row, unsigned int width)
+	{
+		T* data = static_cast<T*>(row);
+		endianUtil::BigEndianToNative(data, data, width);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void EndianConvertRow(void* row, unsigned int width, unsigned int bitsPerChannel)
+	{
+		if (bitsPerChannel == 16)
+		{
+			EndianConvertRow<uint16_t>(row, width);
+		}
+		else if (bitsPerChannel == 32)
+		{
+			EndianConvertRow<float32_t>(row, width);
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static uint16_t* ReadRowDataSizes(SyncFileReader& reader, Allocator* allocator, unsigned int rowCount, unsigned int& totalSize)
+	{
+		// the RLE-compressed data is preceded by a 2-byte data count for each scan line, per channel.
+		// the data counts are kept, because they allow decompressing the rows of each channel independently.
+		uint16_t* rowDataSizes = memoryUtil::AllocateArray<uint16_t>(allocator, rowCount);
+		totalSize = 0u;
+		for (unsigned int i=0; i < rowCount; ++i)
+		{
+			const uint16_t dataCount = fileUtil::ReadFromFileBE<uint16_t>(reader);
+			rowDataSizes[i] = dataCount;
+			totalSize += dataCount;
 		}
+
+		return rowDataSizes;
 	}
 
 
@@ -71,45 +116,250 @@ namespace
 	// ---------------------------------------------------------------------------------------------------------------------
 	static ImageDataSection* ReadImageDataSectionRLE(SyncFileReader& reader, Allocator* allocator, unsigned int width, unsigned int height, unsigned int channelCount, unsigned int bytesPerPixel)
 	{
-		// the RLE-compressed data is preceded by a 2-byte data count for each scan line, per channel.
-		// we store the size of the RLE data per channel, and assume a maximum of 256 channels.
-		PSD_ASSERT(channelCount < 256, "Image data section has too many channels (%d).", channelCount);
-		unsigned int channelSize[256] = {};
 		unsigned int totalSize = 0;
+		uint16_t* rowDataSizes = ReadRowDataSizes(reader, allocator, channelCount*height, totalSize);
+		if (totalSize == 0)
+		{
+			memoryUtil::FreeArray(allocator, rowDataSizes);
+			return nullptr;
+		}
+
+		const unsigned int size = width*height;
+		ImageDataSection* imageData = memoryUtil::Allocate<ImageDataSection>(allocator);
+		imageData->imageCount = channelCount;
+		imageData->images = memoryUtil::AllocateArray<PlanarImage>(allocator, channelCount);
+
 		for (unsigned int i=0; i < channelCount; ++i)
 		{
-			unsigned int size = 0u;
+			void* planarData = allocator->Allocate(size*bytesPerPixel, 16u);
+			imageData->images[i].data = planarData;
+
+			const uint16_t* channelRowDataSizes = rowDataSizes + i*height;
+			unsigned int rleSize = 0u;
 			for (unsigned int j=0; j < height; ++j)
 			{
-				const uint16_t dataCount = fileUtil::ReadFromFileBE<uint16_t>(reader);
-				size += dataCount;
+				rleSize += channelRowDataSizes[j];
+			}
+
+			// read RLE data, and uncompress into planar buffer. the RLE data is only copied into a temporary buffer if the
+			// file cannot hand it out in-place.
+			const uint8_t* rleData = static_cast<const uint8_t*>(reader.ReadSpan(rleSize));
+			uint8_t* stagingData = nullptr;
+			if (!rleData)
+			{
+				stagingData = static_cast<uint8_t*>(allocator->Allocate(rleSize, 4u));
+				reader.Read(stagingData, rleSize);
+				rleData = stagingData;
 			}
 
-			channelSize[i] = size;
-			totalSize += size;
+			imageUtil::DecompressRle(rleData, rleSize, static_cast<uint8_t*>(planarData), width*height*bytesPerPixel);
+
+			if (stagingData)
+			{
+				allocator->Free(stagingData);
+			}
 		}
 
-		if (totalSize == 0)
+		memoryUtil::FreeArray(allocator, rowDataSizes);
+
+		return imageData;
+	}
+
+
+	// rows are only split into separate tasks if each task gets at least this many bytes to decode
+	static const unsigned int MIN_TASK_SIZE = 256u * 1024u;
+	static const unsigned int MAX_TASKS_PER_CHANNEL = 32u;
+
+
+	// a range of rows of a single channel, which is read, decoded, and endian-converted by a single task
+	struct RowRangeTask
+	{
+		File* file;
+		Allocator* allocator;
+		uint64_t position;
+		uint32_t dataSize;
+		void* planarData;
+		unsigned int width;
+		unsigned int rowCount;
+		unsigned int bitsPerChannel;
+		uint16_t compressionType;
+		bool hasFailed;
+	};
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void ReadRowRange(void* data)
+	{
+		RowRangeTask* task = static_cast<RowRangeTask*>(data);
+		File* file = task->file;
+		uint8_t* planarData = static_cast<uint8_t*>(task->planarData);
+		const unsigned int size = task->width * task->rowCount * task->bitsPerChannel / 8u;
+
+		if (task->compressionType == compressionType::RAW)
+		{
+			if (!file->ReadSync(planarData, size, task->position))
+			{
+				PSD_ERROR("ImageData", "Cannot read image data at file position %" PRIu64 ".", task->position);
+				memset(planarData, 0, size);
+				task->hasFailed = true;
+				return;
+			}
+		}
+		else
+		{
+			// the RLE data is only copied into a temporary buffer if the file cannot hand it out in-place
+			const uint8_t* rleData = static_cast<const uint8_t*>(file->GetSpan(task->position, task->dataSize));
+			uint8_t* stagingData = nullptr;
+			if (!rleData)
+			{
+				stagingData = static_cast<uint8_t*>(task->allocator->Allocate(task->dataSize, 4u));
+				if (!file->ReadSync(stagingData, task->dataSize, task->position))
+				{
+					PSD_ERROR("ImageData", "Cannot read image data at file position %" PRIu64 ".", task->position);
+					task->allocator->Free(stagingData);
+					memset(planarData, 0, size);
+					task->hasFailed = true;
+					return;
+				}
+				rleData = stagingData;
+			}
+
+			imageUtil::DecompressRle(rleData, task->dataSize, planarData, size);
+
+			if (stagingData)
+			{
+				task->allocator->Free(stagingData);
+			}
+		}
+
+		// the rows are endian-converted while they are still in the cache
+		EndianConvertRow(planarData, task->width * task->rowCount, task->bitsPerChannel);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static ImageDataSection* ReadImageDataSectionConcurrently(SyncFileReader& reader, File* file, Allocator* allocator, Executor* executor, uint64_t position, uint16_t compressionType, unsigned int width, unsigned int height, unsigned int channelCount, unsigned int bitsPerChannel)
+	{
+		const unsigned int rowSize = width * bitsPerChannel / 8u;
+		const unsigned int channelSize = rowSize * height;
+		if (channelSize == 0u)
 			return nullptr;
 
-		const unsigned int size = width*height;
+		// the data of the channels is stored back-to-back, so the position of each row is known up-front
+		uint16_t* rowDataSizes = nullptr;
+		unsigned int totalSize = channelSize * channelCount;
+		if (compressionType == compressionType::RLE)
+		{
+			rowDataSizes = ReadRowDataSizes(reader, allocator, channelCount*height, totalSize);
+			position += channelCount*height*sizeof(uint16_t);
+
+			if (reader.HasFailed())
+			{
+				PSD_ERROR("ImageData", "Cannot read the sizes of the RLE rows, the file ends early.");
+				memoryUtil::FreeArray(allocator, rowDataSizes);
+				return nullptr;
+			}
+
+			if (totalSize == 0u)
+			{
+				memoryUtil::FreeArray(allocator, rowDataSizes);
+				return nullptr;
+			}
+		}
+
 		ImageDataSection* imageData = memoryUtil::Allocate<ImageDataSection>(allocator);
 		imageData->imageCount = channelCount;
 		imageData->images = memoryUtil::AllocateArray<PlanarImage>(allocator, channelCount);
 
+		// each channel is split into ranges of rows, so that even documents with few channels keep all workers busy
+		unsigned int rangeCount = channelSize / MIN_TASK_SIZE;
+		if (rangeCount > MAX_TASKS_PER_CHANNEL)
+		{
+			rangeCount = MAX_TASKS_PER_CHANNEL;
+		}
+		if (rangeCount > height)
+		{
+			rangeCount = height;
+		}
+		if (rangeCount == 0u)
+		{
+			rangeCount = 1u;
+		}
+
+		const unsigned int taskCount = channelCount * rangeCount;
+		RowRangeTask* rowRanges = memoryUtil::AllocateArray<RowRangeTask>(allocator, taskCount);
 		for (unsigned int i=0; i < channelCount; ++i)
 		{
-			void* planarData = allocator->Allocate(size*bytesPerPixel, 16u);
+			uint8_t* planarData = static_cast<uint8_t*>(allocator->Allocate(channelSize, 16u));
 			imageData->images[i].data = planarData;
 
-			// read RLE data, and uncompress into planar buffer
-			const unsigned int rleSize = channelSize[i];
-			uint8_t* rleData = static_cast<uint8_t*>(allocator->Allocate(rleSize, 4u));
-			reader.Read(rleData, rleSize);
+			unsigned int row = 0u;
+			for (unsigned int j=0; j < rangeCount; ++j)
+			{
+				const unsigned int endRow = static_cast<unsigned int>((static_cast<uint64_t>(height) * (j + 1u)) / rangeCount);
+
+				uint32_t dataSize = (endRow - row) * rowSize;
+				if (rowDataSizes)
+				{
+					dataSize = 0u;
+					for (unsigned int k=row; k < endRow; ++k)
+					{
+						dataSize += rowDataSizes[i*height + k];
+					}
+				}
+
+				RowRangeTask& task = rowRanges[i*rangeCount + j];
+				task.file = file;
+				task.allocator = allocator;
+				task.position = position;
+				task.dataSize = dataSize;
+				task.planarData = planarData + row*rowSize;
+				task.width = width;
+				task.rowCount = endRow - row;
+				task.bitsPerChannel = bitsPerChannel;
+				task.compressionType = compressionType;
+				task.hasFailed = false;
+
+				position += dataSize;
+				row = endRow;
+			}
+		}
 
-			imageUtil::DecompressRle(rleData, rleSize, static_cast<uint8_t*>(planarData), width*height*bytesPerPixel);
+		memoryUtil::FreeArray(allocator, rowDataSizes);
+
+		// announce all reads before the first one is issued. the calling thread decodes the last range on its own instead
+		// of idling until all tasks are finished.
+		file->Prefetch(rowRanges[0].position, position - rowRanges[0].position);
+
+		Executor::Task* tasks = memoryUtil::AllocateArray<Executor::Task>(allocator, taskCount);
+		for (unsigned int i=0; i < taskCount - 1u; ++i)
+		{
+			tasks[i] = executor->Submit(&ReadRowRange, &rowRanges[i]);
+		}
+
+		ReadRowRange(&rowRanges[taskCount - 1u]);
+
+		for (unsigned int i=0; i < taskCount - 1u; ++i)
+		{
+			executor->Wait(tasks[i]);
+		}
+
+		// each failing task has already reported its error, the image is only handed out if all of it could be read
+		bool hasFailed = false;
+		for (unsigned int i=0; i < taskCount; ++i)
+		{
+			hasFailed |= rowRanges[i].hasFailed;
+		}
+
+		memoryUtil::FreeArray(allocator, tasks);
+		memoryUtil::FreeArray(allocator, rowRanges);
 
-			allocator->Free(rleData);
+		if (hasFailed)
+		{
+			DestroyImageDataSection(imageData, allocator);
+			return nullptr;
 		}
 
 		return imageData;
@@ -120,6 +370,14 @@ namespace
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 ImageDataSection* ParseImageDataSection(const Document* document, File* file, Allocator* allocator)
+{
+	return ParseImageDataSection(document, file, allocator, nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+ImageDataSection* ParseImageDataSection(const Document* document, File* file, Allocator* allocator, Executor* executor)
 {
 	PSD_ASSERT_NOT_NULL(file);
 	PSD_ASSERT_NOT_NULL(allocator);
@@ -139,7 +397,7 @@ ImageDataSection* ParseImageDataSection(const Document* document, File* file, Al
 		return nullptr;
 	}
 
-	SyncFileReader reader(file);
+	SyncFileReader reader(file, allocator, SyncFileReader::DEFAULT_READ_AHEAD_SIZE);
 	reader.SetPosition(section.offset);
 
 	ImageDataSection* imageData = nullptr;
@@ -148,7 +406,14 @@ ImageDataSection* ParseImageDataSection(const Document* document, File* file, Al
 	const unsigned int bitsPerChannel = document->bitsPerChannel;
 	const unsigned int channelCount = document->channelCount;
 	const uint16_t compressionType = fileUtil::ReadFromFileBE<uint16_t>(reader);
-	if (compressionType == compressionType::RAW)
+	// bit depths other than 8, 16, and 32 bits take the serial path, which reports them
+	const bool isSupportedBitDepth = (bitsPerChannel == 8u) || (bitsPerChannel == 16u) || (bitsPerChannel == 32u);
+	if (executor && isSupportedBitDepth && ((compressionType == compressionType::RAW) || (compressionType == compressionType::RLE)))
+	{
+		// channels are read and decoded by separate tasks, which also endian-convert the data on the fly
+		return ReadImageDataSectionConcurrently(reader, file, allocator, executor, section.offset + sizeof(uint16_t), compressionType, width, height, channelCount, bitsPerChannel);
+	}
+	else if (compressionType == compressionType::RAW)
 	{
 		imageData = ReadImageDataSectionRaw(reader, allocator, width, height, channelCount, bitsPerChannel / 8u);
 	}
@@ -191,6 +456,102 @@ ImageDataSection* ParseImageDataSection(const Document* document, File* file, Al
 }
 
 
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamImageDataSection(const Document* document, File* file, Allocator* allocator, StreamListener* listener)
+{
+	PSD_ASSERT_NOT_NULL(file);
+	PSD_ASSERT_NOT_NULL(allocator);
+	PSD_ASSERT_NOT_NULL(listener);
+
+	const Section& section = document->imageDataSection;
+	if (section.length == 0)
+	{
+		PSD_ERROR("PSD", "Document does not contain an image data section.");
+		return false;
+	}
+
+	SyncFileReader reader(file, allocator, SyncFileReader::DEFAULT_READ_AHEAD_SIZE);
+	reader.SetPosition(section.offset);
+
+	const unsigned int width = document->width;
+	const unsigned int height = document->height;
+	const unsigned int bitsPerChannel = document->bitsPerChannel;
+	const unsigned int channelCount = document->channelCount;
+	const unsigned int rowSize = width * bitsPerChannel / 8u;
+	const uint16_t compressionType = fileUtil::ReadFromFileBE<uint16_t>(reader);
+	if ((compressionType != compressionType::RAW) && (compressionType != compressionType::RLE))
+	{
+		PSD_ERROR("ImageData", "Unhandled compression type %u.", compressionType);
+		return false;
+	}
+
+	uint8_t* rowData = static_cast<uint8_t*>(allocator->Allocate(rowSize, 16u));
+
+	// rows are only handed to the listener as long as all reads succeed, e.g. until a stream ends early
+	if (compressionType == compressionType::RAW)
+	{
+		for (unsigned int i=0; (i < channelCount) && !reader.HasFailed(); ++i)
+		{
+			for (unsigned int j=0; j < height; ++j)
+			{
+				reader.Read(rowData, rowSize);
+				if (reader.HasFailed())
+					break;
+
+				EndianConvertRow(rowData, width, bitsPerChannel);
+				listener->OnMergedImageRow(document, i, j, rowData);
+			}
+		}
+	}
+	else
+	{
+		// the RLE-compressed data is preceded by a 2-byte data count for each scan line, per channel. each row is
+		// decompressed on its own, so only the largest compressed row needs to be held in memory.
+		const unsigned int rowCount = channelCount * height;
+		uint16_t* rowCounts = memoryUtil::AllocateArray<uint16_t>(allocator, rowCount);
+		unsigned int maxCount = 0u;
+		for (unsigned int i=0; i < rowCount; ++i)
+		{
+			rowCounts[i] = fileUtil::ReadFromFileBE<uint16_t>(reader);
+			if (rowCounts[i] > maxCount)
+			{
+				maxCount = rowCounts[i];
+			}
+		}
+
+		uint8_t* rleData = static_cast<uint8_t*>(allocator->Allocate(maxCount, 4u));
+		for (unsigned int i=0; (i < channelCount) && !reader.HasFailed(); ++i)
+		{
+			for (unsigned int j=0; j < height; ++j)
+			{
+				const unsigned int rleSize = rowCounts[i*height + j];
+				reader.Read(rleData, rleSize);
+				if (reader.HasFailed())
+					break;
+
+				imageUtil::DecompressRle(rleData, rleSize, rowData, rowSize);
+				EndianConvertRow(rowData, width, bitsPerChannel);
+				listener->OnMergedImageRow(document, i, j, rowData);
+			}
+		}
+
+		allocator->Free(rleData);
+		memoryUtil::FreeArray(allocator, rowCounts);
+	}
+
+	allocator->Free(rowData);
+
+	if (reader.HasFailed())
+	{
+		PSD_ERROR("ImageData", "Cannot read image data, the file ends early.");
+		return false;
+	}
+
+	return true;
+}
+
+
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 void DestroyImageDataSection(ImageDataSection*& section, Allocator* allocator)
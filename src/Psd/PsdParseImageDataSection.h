@@ -10,6 +10,8 @@ struct Document;
 class File;
 class Allocator;
 struct ImageDataSection;
+class StreamListener;
+class Executor;
 
 
 /// \ingroup Parser
@@ -19,6 +21,21 @@ struct ImageDataSection;
 /// or \ref ParseLayerMaskSection) in parallel from different threads.
 ImageDataSection* ParseImageDataSection(const Document* document, File* file, Allocator* allocator);
 
+/// \ingroup Parser
+/// Parses the image data section in the document like \ref ParseImageDataSection, but reads and decodes the channels
+/// concurrently using the given \a executor. Each channel is split into ranges of rows, and each range is read, decompressed
+/// and endian-converted by a separate task, writing straight into its part of the channel's planar data.
+/// \remark Tasks read from the \a file and allocate from the \a allocator at the same time, hence both must be thread-safe.
+ImageDataSection* ParseImageDataSection(const Document* document, File* file, Allocator* allocator, Executor* executor);
+
+/// \ingroup Parser
+/// Parses the image data section in the document in a single forward pass, handing each row of each channel to the
+/// \a listener in file order. Returns whether the section could be parsed completely, which is not the case if the file
+/// ends early. No rows are handed to the listener after a read failed.
+/// \remark Only a single row of the merged image is held in memory at any time.
+/// \sa StreamDocument
+bool StreamImageDataSection(const Document* document, File* file, Allocator* allocator, StreamListener* listener);
+
 /// \ingroup Parser
 /// Destroys and nullifies the given \a section previously created by a call to \ref ParseImageDataSection.
 void DestroyImageDataSection(ImageDataSection*& section, Allocator* allocator);
@@ -38,7 +38,7 @@ ImageResourcesSection* ParseImageResourcesSection(const Document* document, File
 	imageResources->xmpMetadata = nullptr;
 	imageResources->thumbnail = nullptr;
 
-	SyncFileReader reader(file);
+	SyncFileReader reader(file, allocator, SyncFileReader::DEFAULT_READ_AHEAD_SIZE);
 	reader.SetPosition(document->imageResourcesSection.offset);
 
 	int64_t leftToRead = document->imageResourcesSection.length;
@@ -13,7 +13,9 @@
 #include "PsdCompressionType.h"
 #include "PsdLayerType.h"
 #include "PsdFile.h"
+#include "PsdMemoryFile.h"
 #include "PsdLayerMaskSection.h"
+#include "PsdStreamListener.h"
 #include "PsdKey.h"
 #include "PsdBitUtil.h"
 #include "PsdEndianConversion.h"
@@ -249,95 +251,166 @@ namespace
 		PSD_ASSERT_NOT_NULL(src);
 
 		T* data = static_cast<T*>(src);
-		const unsigned int size = width*height;
+		endianUtil::BigEndianToNative(data, data, width*height);
+	}
+
+
+	// channel data is decoded in blocks of rows that fit into the L1 cache, and each block is post-processed right after
+	// it has been decoded. this touches the channel's memory only once, instead of once for decoding and once for each
+	// post-processing step.
+	static const unsigned int ROW_BLOCK_SIZE = 16u * 1024u;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static unsigned int GetBlockRowCount(unsigned int rowSize)
+	{
+		return (rowSize < ROW_BLOCK_SIZE) ? (ROW_BLOCK_SIZE / rowSize) : 1u;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	static void ApplyPrediction(T* PSD_RESTRICT rowData, unsigned int width, uint8_t* PSD_RESTRICT scratch)
+	{
+		static_assert(sizeof(T) == -1, "Unknown data type.");
+	}
 
-		for (unsigned int i=0; i < size; ++i)
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <>
+	void ApplyPrediction<uint8_t>(uint8_t* PSD_RESTRICT rowData, unsigned int width, uint8_t* PSD_RESTRICT)
+	{
+		uint8_t* buffer = rowData;
+		++buffer;
+		for (unsigned int x = 1; x < width; ++x)
 		{
-			data[i] = endianUtil::BigEndianToNative(data[i]);
+			const uint32_t previous = buffer[-1];
+			const uint32_t current = buffer[0];
+			const uint32_t value = current + previous;
+
+			*buffer++ = static_cast<uint8_t>(value & 0xFFu);
 		}
 	}
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
-	template <typename T>
-	static void* ReadChannelDataRaw(SyncFileReader& reader, Allocator* allocator, unsigned int width, unsigned int height)
+	template <>
+	void ApplyPrediction<uint16_t>(uint16_t* PSD_RESTRICT rowData, unsigned int width, uint8_t* PSD_RESTRICT)
 	{
-		const unsigned int size = width*height;
-		if (size > 0)
+		// 16-bit images are delta-encoded word-by-word.
+		// the deltas are big-endian and must be reversed first for further processing. note that this is done
+		// in-place with the delta-decoding.
+		uint16_t* buffer = rowData;
+		const uint16_t first = *buffer;
+		*buffer++ = endianUtil::BigEndianToNative(first);
+		for (unsigned int x=1; x < width; ++x)
 		{
-			void* planarData = allocator->Allocate(size*sizeof(T), 16u);
-			reader.Read(planarData, size*sizeof(T));
+			buffer[0] = endianUtil::BigEndianToNative(buffer[0]);
 
-			EndianConvert<T>(planarData, width, height);
+			const uint32_t previous = buffer[-1];
+			const uint32_t current = buffer[0];
+			const uint32_t value = current + previous;
 
-			return planarData;
+			// note that the data written here is now in little-endian format
+			*buffer++ = static_cast<uint16_t>(value & 0xFFFFu);
 		}
-
-		return nullptr;
 	}
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
-	template <typename T>
-	static void* ReadChannelDataRLE(SyncFileReader& reader, Allocator* allocator, unsigned int width, unsigned int height)
+	template <>
+	void ApplyPrediction<float32_t>(float32_t* PSD_RESTRICT rowData, unsigned int width, uint8_t* PSD_RESTRICT scratch)
 	{
-		// the RLE-compressed data is preceded by a 2-byte data count for each scan line
-		const unsigned int size = width*height;
+		// the bytes are delta-decoded into the scratch row first, because interleaving them cannot be done in-place
+		const uint8_t* src = reinterpret_cast<const uint8_t*>(rowData);
+		scratch[0] = src[0];
+		for (unsigned int x=1; x < width*4; ++x)
+		{
+			const uint32_t previous = scratch[x - 1];
+			const uint32_t current = src[x];
+			const uint32_t value = current + previous;
 
-		unsigned int rleDataSize = 0u;
-		for (unsigned int i=0; i < height; ++i)
+			scratch[x] = static_cast<uint8_t>(value & 0xFFu);
+		}
+
+		// the bytes of the 32-bit float are stored in planar fashion per row, big-endian format.
+		// interleave the bytes, and store them in little-endian format at the same time.
+		uint8_t* dest = reinterpret_cast<uint8_t*>(rowData);
+		const uint8_t* src0 = scratch;
+		const uint8_t* src1 = scratch + 1*width;
+		const uint8_t* src2 = scratch + 2*width;
+		const uint8_t* src3 = scratch + 3*width;
+		for (unsigned int x=0; x < width; ++x)
 		{
-			const uint16_t dataCount = fileUtil::ReadFromFileBE<uint16_t>(reader);
-			rleDataSize += dataCount;
+			// write data in little-endian format
+			dest[0] = *src3++;
+			dest[1] = *src2++;
+			dest[2] = *src1++;
+			dest[3] = *src0++;
+			dest += 4u;
 		}
+	}
 
-		if (rleDataSize > 0)
+
+	// post-processes rows of ZIP-compressed channels
+	template <typename T>
+	struct EndianConvertRows
+	{
+		static void Apply(T* rowData, unsigned int width, unsigned int rowCount, uint8_t*)
 		{
-			void* planarData = allocator->Allocate(size*sizeof(T), 16u);
+			endianUtil::BigEndianToNative(rowData, rowData, width*rowCount);
+		}
+	};
 
-			// decompress RLE
-			void* rleData = allocator->Allocate(rleDataSize, 4u);
+
+	// post-processes rows of ZIP-compressed channels with prediction. the data generated by applying the prediction is
+	// already in little-endian format, so it doesn't have to be endian converted further.
+	template <typename T>
+	struct PredictRows
+	{
+		static void Apply(T* rowData, unsigned int width, unsigned int rowCount, uint8_t* scratch)
+		{
+			for (unsigned int y=0; y < rowCount; ++y)
 			{
-				reader.Read(rleData, rleDataSize);
-				imageUtil::DecompressRle(static_cast<const uint8_t*>(rleData), rleDataSize, static_cast<uint8_t*>(planarData), width*height*sizeof(T));
+				ApplyPrediction<T>(rowData + y*width, width, scratch);
 			}
-			allocator->Free(rleData);
-
-			EndianConvert<T>(planarData, width, height);
-
-			return planarData;
 		}
-
-		return nullptr;
-	}
+	};
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
 	template <typename T>
-	static void* ReadChannelDataZip(SyncFileReader& reader, Allocator* allocator, unsigned int width, unsigned int height, uint32_t channelSize)
+	static void* ReadChannelDataRaw(SyncFileReader& reader, Allocator* allocator, unsigned int width, unsigned int height)
 	{
-		if (channelSize > 0)
+		const unsigned int size = width*height;
+		if (size > 0)
 		{
-			const unsigned int size = width*height;
-
-			T* planarData = static_cast<T*>(allocator->Allocate(size*sizeof(T), 16));
-
-			void* zipData = allocator->Allocate(channelSize, 4u);
-			reader.Read(zipData, channelSize);
+			T* planarData = static_cast<T*>(allocator->Allocate(size*sizeof(T), 16u));
 
-			// the zipped data stream has a zlib-header
-			const size_t status = tinfl_decompress_mem_to_mem(planarData, size*sizeof(T), zipData, channelSize, TINFL_FLAG_PARSE_ZLIB_HEADER);
-			if (status == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED)
+			// the data is endian converted straight from the file if it can be handed out in-place, and block by block
+			// otherwise.
+			const T* rawData = static_cast<const T*>(reader.ReadSpan(size*sizeof(T)));
+			if (rawData)
 			{
-				PSD_ERROR("PsdExtract", "Error while unzipping channel data.");
+				endianUtil::BigEndianToNative(rawData, planarData, size);
+				return planarData;
 			}
 
-			allocator->Free(zipData);
+			const unsigned int blockRowCount = GetBlockRowCount(width*sizeof(T));
+			for (unsigned int y=0; y < height; y += blockRowCount)
+			{
+				const unsigned int rowCount = (height - y < blockRowCount) ? (height - y) : blockRowCount;
+				T* blockData = planarData + y*width;
 
-			EndianConvert<T>(planarData, width, height);
+				reader.Read(blockData, width*rowCount*sizeof(T));
+				endianUtil::BigEndianToNative(blockData, blockData, width*rowCount);
+			}
 
 			return planarData;
 		}
@@ -349,154 +422,323 @@ namespace
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
 	template <typename T>
-	static void ApplyPrediction(Allocator* allocator, void* PSD_RESTRICT planarData, unsigned int width, unsigned int height)
+	static void DecompressRleBlocks(const uint8_t* rleData, const uint16_t* rowDataSizes, T* planarData, unsigned int width, unsigned int height)
 	{
-		static_assert(sizeof(T) == -1, "Unknown data type.");
+		// every row ends on a token boundary, so all rows of a block can be decompressed in one go
+		const unsigned int blockRowCount = GetBlockRowCount(width*sizeof(T));
+		for (unsigned int y=0; y < height; y += blockRowCount)
+		{
+			const unsigned int rowCount = (height - y < blockRowCount) ? (height - y) : blockRowCount;
+			T* blockData = planarData + y*width;
+
+			unsigned int blockSize = 0u;
+			for (unsigned int i=0; i < rowCount; ++i)
+			{
+				blockSize += rowDataSizes[y + i];
+			}
+
+			imageUtil::DecompressRle(rleData, blockSize, reinterpret_cast<uint8_t*>(blockData), width*rowCount*sizeof(T));
+			endianUtil::BigEndianToNative(blockData, blockData, width*rowCount);
+
+			rleData += blockSize;
+		}
 	}
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
-	template <>
-	void ApplyPrediction<uint8_t>(Allocator*, void* PSD_RESTRICT planarData, unsigned int width, unsigned int height)
+	template <typename T>
+	static void* ReadChannelDataRLE(SyncFileReader& reader, Allocator* allocator, Executor* executor, unsigned int width, unsigned int height)
 	{
-		uint8_t* buffer = static_cast<uint8_t*>(planarData);
-		for (unsigned int y = 0; y < height; ++y)
+		// the RLE-compressed data is preceded by a 2-byte data count for each scan line. the data counts are kept, because
+		// they allow decompressing the rows independently.
+		uint16_t* rowDataSizes = memoryUtil::AllocateArray<uint16_t>(allocator, height);
+
+		unsigned int rleDataSize = 0u;
+		for (unsigned int i=0; i < height; ++i)
+		{
+			const uint16_t dataCount = fileUtil::ReadFromFileBE<uint16_t>(reader);
+			rowDataSizes[i] = dataCount;
+			rleDataSize += dataCount;
+		}
+
+		T* planarData = nullptr;
+		if (rleDataSize > 0)
 		{
-			++buffer;
-			for (unsigned int x = 1; x < width; ++x)
+			planarData = static_cast<T*>(allocator->Allocate(width*height*sizeof(T), 16u));
+
+			// decompress RLE. the compressed data is only copied into a temporary buffer if the file cannot hand it out in-place.
+			const void* rleData = reader.ReadSpan(rleDataSize);
+			void* stagingData = nullptr;
+			if (!rleData)
+			{
+				stagingData = allocator->Allocate(rleDataSize, 4u);
+				reader.Read(stagingData, rleDataSize);
+				rleData = stagingData;
+			}
+
+			if (executor)
+			{
+				// rows are decompressed concurrently, and endian converted afterwards
+				imageUtil::DecompressRleRows(static_cast<const uint8_t*>(rleData), rowDataSizes, height, reinterpret_cast<uint8_t*>(planarData), width*sizeof(T), executor);
+				EndianConvert<T>(planarData, width, height);
+			}
+			else
 			{
-				const uint32_t previous = buffer[-1];
-				const uint32_t current = buffer[0];
-				const uint32_t value = current + previous;
+				DecompressRleBlocks<T>(static_cast<const uint8_t*>(rleData), rowDataSizes, planarData, width, height);
+			}
 
-				*buffer++ = static_cast<uint8_t>(value & 0xFFu);
+			if (stagingData)
+			{
+				allocator->Free(stagingData);
 			}
 		}
+
+		memoryUtil::FreeArray(allocator, rowDataSizes);
+
+		return planarData;
 	}
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
-	template <>
-	void ApplyPrediction<uint16_t>(Allocator*, void* PSD_RESTRICT planarData, unsigned int width, unsigned int height)
+	template <typename T, typename RowProcessor>
+	static void* ReadChannelDataZip(SyncFileReader& reader, Allocator* allocator, unsigned int width, unsigned int height, uint32_t channelSize)
 	{
-		// 16-bit images are delta-encoded word-by-word.
-		// the deltas are big-endian and must be reversed first for further processing. note that this is done
-		// in-place with the delta-decoding.
+		if (channelSize > 0)
 		{
-			uint16_t* buffer = static_cast<uint16_t*>(planarData);
-			for (unsigned int y=0; y < height; ++y)
+			const unsigned int rowSize = width*sizeof(T);
+			const size_t size = static_cast<size_t>(rowSize)*height;
+			if (size == 0u)
+			{
+				// empty layers can still store an empty zlib stream, which does not hold any data
+				reader.Skip(channelSize);
+				return nullptr;
+			}
+
+			T* planarData = static_cast<T*>(allocator->Allocate(size, 16));
+
+			// the compressed data is only copied into a temporary buffer if the file cannot hand it out in-place
+			const void* zipData = reader.ReadSpan(channelSize);
+			void* stagingData = nullptr;
+			if (!zipData)
+			{
+				stagingData = allocator->Allocate(channelSize, 4u);
+				reader.Read(stagingData, channelSize);
+				zipData = stagingData;
+			}
+
+			// the data is inflated into a small dictionary that wraps around, from where each piece is copied into the
+			// planar buffer. all rows completed by a piece are post-processed right away, while they are still in the cache.
+			tinfl_decompressor* inflator = memoryUtil::Allocate<tinfl_decompressor>(allocator);
+			uint8_t* dictionary = static_cast<uint8_t*>(allocator->Allocate(TINFL_LZ_DICT_SIZE, 16u));
+			uint8_t* scratch = static_cast<uint8_t*>(allocator->Allocate(rowSize, 16u));
+			tinfl_init(inflator);
+
+			const uint8_t* src = static_cast<const uint8_t*>(zipData);
+			size_t srcLeft = channelSize;
+			size_t dictionaryOffset = 0u;
+			size_t decodedSize = 0u;
+			unsigned int processedRowCount = 0u;
+			for (;;)
 			{
-				const uint16_t first = *buffer;
-				*buffer++ = endianUtil::BigEndianToNative(first);
-				for (unsigned int x=1; x < width; ++x)
+				// the zipped data stream has a zlib-header
+				size_t srcCount = srcLeft;
+				size_t destCount = TINFL_LZ_DICT_SIZE - dictionaryOffset;
+				const tinfl_status status = tinfl_decompress(inflator, src, &srcCount, dictionary, dictionary + dictionaryOffset, &destCount, TINFL_FLAG_PARSE_ZLIB_HEADER);
+				src += srcCount;
+				srcLeft -= srcCount;
+
+				const bool isTooLarge = (destCount > size - decodedSize);
+				if (isTooLarge)
 				{
-					buffer[0] = endianUtil::BigEndianToNative(buffer[0]);
+					destCount = size - decodedSize;
+				}
+
+				memcpy(reinterpret_cast<uint8_t*>(planarData) + decodedSize, dictionary + dictionaryOffset, destCount);
+				decodedSize += destCount;
+
+				const unsigned int rowCount = static_cast<unsigned int>(decodedSize / rowSize);
+				RowProcessor::Apply(planarData + processedRowCount*width, width, rowCount - processedRowCount, scratch);
+				processedRowCount = rowCount;
 
-					const uint32_t previous = buffer[-1];
-					const uint32_t current = buffer[0];
-					const uint32_t value = current + previous;
+				if ((status == TINFL_STATUS_HAS_MORE_OUTPUT) && !isTooLarge)
+				{
+					dictionaryOffset = (dictionaryOffset + destCount) & (TINFL_LZ_DICT_SIZE - 1u);
+					continue;
+				}
 
-					// note that the data written here is now in little-endian format
-					*buffer++ = static_cast<uint16_t>(value & 0xFFFFu);
+				// the stream must end exactly after the last row, anything else means the data is truncated or corrupt
+				if ((status != TINFL_STATUS_DONE) || isTooLarge || (decodedSize != size))
+				{
+					PSD_ERROR("PsdExtract", "Error while unzipping channel data.");
+					memset(reinterpret_cast<uint8_t*>(planarData) + decodedSize, 0, size - decodedSize);
 				}
+
+				break;
+			}
+
+			allocator->Free(scratch);
+			allocator->Free(dictionary);
+			memoryUtil::Free(allocator, inflator);
+
+			if (stagingData)
+			{
+				allocator->Free(stagingData);
 			}
+
+			return planarData;
 		}
+
+		return nullptr;
 	}
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
-	template <>
-	void ApplyPrediction<float32_t>(Allocator* allocator, void* PSD_RESTRICT planarData, unsigned int width, unsigned int height)
+	static bool ExtractChannel(const Document* document, SyncFileReader& reader, Allocator* allocator, Executor* executor, const Layer* layer, Channel* channel)
 	{
-		// delta-decode row by row first
+		unsigned int width = 0u;
+		unsigned int height = 0u;
+		GetChannelExtents(layer, channel, width, height);
+
+		PSD_ASSERT(channel->data == nullptr, "Channel data has already been loaded.");
+
+		// channel data is stored in 4 different formats, which is denoted by a 2-byte integer
+		const uint16_t compressionType = fileUtil::ReadFromFileBE<uint16_t>(reader);
+		if (compressionType == compressionType::RAW)
 		{
-			uint8_t* buffer = static_cast<uint8_t*>(planarData);
-			for (unsigned int y=0; y < height; ++y)
+			if (document->bitsPerChannel == 8)
 			{
-				++buffer;
-				for (unsigned int x=1; x < width*4; ++x)
-				{
-					const uint32_t previous = buffer[-1];
-					const uint32_t current = buffer[0];
-					const uint32_t value = current + previous;
-
-					*buffer++ = static_cast<uint8_t>(value & 0xFFu);
-				}
+				channel->data = ReadChannelDataRaw<uint8_t>(reader, allocator, width, height);
+			}
+			else if (document->bitsPerChannel == 16)
+			{
+				channel->data = ReadChannelDataRaw<uint16_t>(reader, allocator, width, height);
+			}
+			else if (document->bitsPerChannel == 32)
+			{
+				channel->data = ReadChannelDataRaw<float32_t>(reader, allocator, width, height);
 			}
 		}
-
-		// the bytes of the 32-bit float are stored in planar fashion per row, big-endian format.
-		// interleave the bytes, and store them in little-endian format at the same time.
-		uint8_t* rowData = static_cast<uint8_t*>(allocator->Allocate(width*sizeof(float32_t), 16));
+		else if (compressionType == compressionType::RLE)
+		{
+			if (document->bitsPerChannel == 8)
+			{
+				channel->data = ReadChannelDataRLE<uint8_t>(reader, allocator, executor, width, height);
+			}
+			else if (document->bitsPerChannel == 16)
+			{
+				channel->data = ReadChannelDataRLE<uint16_t>(reader, allocator, executor, width, height);
+			}
+			else if (document->bitsPerChannel == 32)
+			{
+				channel->data = ReadChannelDataRLE<float32_t>(reader, allocator, executor, width, height);
+			}
+		}
+		else if (compressionType == compressionType::ZIP)
 		{
-			uint8_t* dest = static_cast<uint8_t*>(planarData);
-			for (unsigned int y=0; y < height; ++y)
+			// note that we need to subtract 2 bytes from the channel data size because we already read the uint16_t
+			// for the compression type.
+			PSD_ASSERT(channel->size >= 2, "Invalid channel data size %d.", channel->size);
+			const uint32_t channelDataSize = channel->size - 2u;
+			if (document->bitsPerChannel == 8)
 			{
-				// copy first row of data to backup storage, because it will be overwritten inside our loop.
-				// note that this operation cannot be done in-place, that's why we work row by row.
-				memcpy(rowData, dest, width*sizeof(float32_t));
-
-				const uint8_t* src0 = rowData;
-				const uint8_t* src1 = rowData + 1*width;
-				const uint8_t* src2 = rowData + 2*width;
-				const uint8_t* src3 = rowData + 3*width;
+				channel->data = ReadChannelDataZip<uint8_t, EndianConvertRows<uint8_t> >(reader, allocator, width, height, channelDataSize);
+			}
+			else if (document->bitsPerChannel == 16)
+			{
+				channel->data = ReadChannelDataZip<uint16_t, EndianConvertRows<uint16_t> >(reader, allocator, width, height, channelDataSize);
+			}
+			else if (document->bitsPerChannel == 32)
+			{
+				// note that this is NOT a bug.
+				// in 32-bit mode, Photoshop always interprets ZIP compression as being ZIP_WITH_PREDICTION, presumably to get better compression when writing files.
+				channel->data = ReadChannelDataZip<float32_t, PredictRows<float32_t> >(reader, allocator, width, height, channelDataSize);
+			}
+		}
+		else if (compressionType == compressionType::ZIP_WITH_PREDICTION)
+		{
+			// note that we need to subtract 2 bytes from the channel data size because we already read the uint16_t
+			// for the compression type.
+			PSD_ASSERT(channel->size >= 2, "Invalid channel data size %d.", channel->size);
+			const uint32_t channelDataSize = channel->size - 2u;
+			if (document->bitsPerChannel == 8)
+			{
+				channel->data = ReadChannelDataZip<uint8_t, PredictRows<uint8_t> >(reader, allocator, width, height, channelDataSize);
+			}
+			else if (document->bitsPerChannel == 16)
+			{
+				channel->data = ReadChannelDataZip<uint16_t, PredictRows<uint16_t> >(reader, allocator, width, height, channelDataSize);
+			}
+			else if (document->bitsPerChannel == 32)
+			{
+				channel->data = ReadChannelDataZip<float32_t, PredictRows<float32_t> >(reader, allocator, width, height, channelDataSize);
+			}
+		}
+		else
+		{
+			PSD_ASSERT(false, "Unsupported compression type %d", compressionType);
+			return false;
+		}
 
-				for (unsigned int x=0; x < width; ++x)
-				{
-					// write data in little-endian format
-					dest[0] = *src3++;
-					dest[1] = *src2++;
-					dest[2] = *src1++;
-					dest[3] = *src0++;
-					dest += 4u;
-				}
+		// if the channel doesn't have any data assigned to it, check if it is a mask channel of any kind.
+		// layer masks sometimes don't have any planar data stored for them, because they are
+		// e.g. pure black or white, which means they only get assigned a default color.
+		if (!channel->data)
+		{
+			if (channel->type < 0)
+			{
+				// this is a layer mask, so create planar data for it
+				const size_t dataSize = width * height * document->bitsPerChannel / 8u;
+				void* channelData = allocator->Allocate(dataSize, 16u);
+				memset(channelData, GetChannelDefaultColor(layer, channel), dataSize);
+				channel->data = channelData;
+			}
+			else
+			{
+				// for layers like groups and group end markers ("</Layer group>") it is ok to not store any data
 			}
 		}
 
-		allocator->Free(rowData);
+		return true;
 	}
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
-	template <typename T>
-	static void* ReadChannelDataZipPrediction(SyncFileReader& reader, Allocator* allocator, unsigned int width, unsigned int height, uint32_t channelSize)
+	static void BuildLayerHierarchy(LayerMaskSection* layerMaskSection)
 	{
-		if (channelSize > 0)
-		{
-			const unsigned int size = width*height;
+		Layer* layerStack[256] = {};
+		layerStack[0] = nullptr;
+		int stackIndex = 0;
 
-			T* planarData = static_cast<T*>(allocator->Allocate(size*sizeof(T), 16));
+		for (unsigned int i=0; i < layerMaskSection->layerCount; ++i)
+		{
+			// note that it is much easier to build the hierarchy by traversing the layers backwards
+			Layer* layer = &layerMaskSection->layers[layerMaskSection->layerCount - i - 1u];
 
-			void* zipData = allocator->Allocate(channelSize, 4u);
-			reader.Read(zipData, channelSize);
+			PSD_ASSERT(stackIndex >= 0 && stackIndex < 256, "Stack index is out of bounds.");
+			layer->parent = layerStack[stackIndex];
 
-			// the zipped data stream has a zlib-header
-			const size_t status = tinfl_decompress_mem_to_mem(planarData, size*sizeof(T), zipData, channelSize, TINFL_FLAG_PARSE_ZLIB_HEADER);
-			if (status == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED)
+			const bool isGroupStart = (layer->type == layerType::OPEN_FOLDER) || (layer->type == layerType::CLOSED_FOLDER);
+			const bool isGroupEnd = (layer->type == layerType::SECTION_DIVIDER);
+			if (isGroupEnd)
 			{
-				PSD_ERROR("PsdExtract", "Error while unzipping channel data.");
+				--stackIndex;
+			}
+			else if (isGroupStart)
+			{
+				++stackIndex;
+				layerStack[stackIndex] = layer;
 			}
-
-			allocator->Free(zipData);
-
-			// the data generated by applying the prediction data is already in little-endian format, so it doesn't have to be
-			// endian converted further.
-			ApplyPrediction<T>(allocator, planarData, width, height);
-
-			return planarData;
 		}
-
-		return nullptr;
 	}
 
 
 	// ---------------------------------------------------------------------------------------------------------------------
 	// ---------------------------------------------------------------------------------------------------------------------
-	static LayerMaskSection* ParseLayer(const Document* document, SyncFileReader& reader, Allocator* allocator, uint64_t sectionOffset, uint32_t sectionLength, uint32_t layerLength)
+	static LayerMaskSection* ParseLayer(const Document* document, SyncFileReader& reader, Allocator* allocator, uint64_t sectionOffset, uint32_t sectionLength, uint32_t layerLength, StreamListener* listener)
 	{
 		LayerMaskSection* layerMaskSection = memoryUtil::Allocate<LayerMaskSection>(allocator);
 		layerMaskSection->layers = nullptr;
@@ -749,17 +991,44 @@ namespace
 				}
 			}
 
-			// walk through the layers and channels, but don't extract their data just yet. only save the file offset for extracting the
-			// data later.
-			for (unsigned int i=0; i < layerMaskSection->layerCount; ++i)
+			// when streaming, the channel data directly following the layer records is decoded right away, otherwise
+			// the data is only extracted later on.
+			if (listener)
 			{
-				Layer* layer = &layerMaskSection->layers[i];
-				const unsigned int channelCount = layer->channelCount;
-				for (unsigned int j=0; j < channelCount; ++j)
+				BuildLayerHierarchy(layerMaskSection);
+				for (unsigned int i=0; i < layerMaskSection->layerCount; ++i)
+				{
+					listener->OnLayerRecord(document, &layerMaskSection->layers[i]);
+				}
+			}
+
+			// walk through the layers and channels, saving the file offset of each channel.
+			for (unsigned int i=0; i < layerMaskSection->layerCount; ++i)
+			{
+				Layer* layer = &layerMaskSection->layers[i];
+				const unsigned int channelCount = layer->channelCount;
+				for (unsigned int j=0; j < channelCount; ++j)
 				{
 					Channel* channel = &layer->channels[j];
 					channel->fileOffset = reader.GetPosition();
-					reader.Skip(channel->size);
+
+					if (listener && (channel->size >= sizeof(uint16_t)))
+					{
+						// channels are only handed to the listener as long as all reads succeed
+						if (!ExtractChannel(document, reader, allocator, nullptr, layer, channel) || reader.HasFailed())
+							return layerMaskSection;
+
+						listener->OnChannel(document, layer, channel);
+
+						// the listener either took ownership of the data, or it is not needed anymore
+						allocator->Free(channel->data);
+						channel->data = nullptr;
+						reader.SetPosition(channel->fileOffset + channel->size);
+					}
+					else
+					{
+						reader.Skip(channel->size);
+					}
 				}
 			}
 		}
@@ -818,14 +1087,14 @@ namespace
 					{
 						const uint64_t offset = reader.GetPosition();
 						DestroyLayerMaskSection(layerMaskSection, allocator);
-						layerMaskSection = ParseLayer(document, reader, allocator, 0u, 0u, length);
+						layerMaskSection = ParseLayer(document, reader, allocator, 0u, 0u, length, listener);
 						reader.SetPosition(offset + length);
 					}
 					else if (key == util::Key<'L', 'r', '3', '2'>::VALUE)
 					{
 						const uint64_t offset = reader.GetPosition();
 						DestroyLayerMaskSection(layerMaskSection, allocator);
-						layerMaskSection = ParseLayer(document, reader, allocator, 0u, 0u, length);
+						layerMaskSection = ParseLayer(document, reader, allocator, 0u, 0u, length, listener);
 						reader.SetPosition(offset + length);
 					}
 					else if (key == util::Key<'v', 'm', 's', 'k'>::VALUE)
@@ -850,6 +1119,130 @@ namespace
 
 		return layerMaskSection;
 	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void MoveChannelsToMasks(Layer* layer)
+	{
+		const unsigned int channelCount = layer->channelCount;
+		for (unsigned int i=0; i < channelCount; ++i)
+		{
+			Channel* channel = &layer->channels[i];
+			if (channel->type == channelType::LAYER_OR_VECTOR_MASK)
+			{
+				if (layer->vectorMask)
+				{
+					// layer has a vector mask, so this type always denotes the vector mask
+					PSD_ASSERT(!layer->vectorMask->data, "Vector mask data has already been assigned.");
+					MoveChannelToMask(channel, layer->vectorMask);
+				}
+				else if (layer->layerMask)
+				{
+					// we don't have a vector but a layer mask, so this type denotes the layer mask
+					PSD_ASSERT(!layer->layerMask->data, "Layer mask data has already been assigned.");
+					MoveChannelToMask(channel, layer->layerMask);
+				}
+				else
+				{
+					PSD_ASSERT(false, "The code failed to create a mask for this type internally. This should never happen.");
+				}
+			}
+			else if (channel->type == channelType::LAYER_MASK)
+			{
+				PSD_ASSERT(layer->layerMask, "Layer mask must already exist.");
+				PSD_ASSERT(!layer->layerMask->data, "Layer mask data has already been assigned.");
+				MoveChannelToMask(channel, layer->layerMask);
+			}
+			else
+			{
+				// this channel is either a color channel, or the transparency mask. those should be stored in our channel array,
+				// so there's nothing to do.
+			}
+		}
+	}
+
+
+	// channels lying at most this many bytes apart are fetched using a single read by default
+	static const uint32_t DEFAULT_MAX_READ_GAP = 64u * 1024u;
+
+	// channels are not merged into reads larger than this, which bounds the memory needed for holding a read
+	static const uint64_t MAX_MERGED_READ_SIZE = 64u * 1024u * 1024u;
+
+
+	struct PlannedChannel
+	{
+		Layer* layer;
+		Channel* channel;
+		unsigned int layerIndex;
+	};
+
+
+	struct PlannedRead
+	{
+		uint64_t position;
+		uint64_t size;
+		unsigned int firstChannel;
+		unsigned int channelCount;
+	};
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void SortChannelsByOffset(PlannedChannel* channels, unsigned int count)
+	{
+		// the channels of layers given in record order are already sorted, in which case insertion sort runs in linear time
+		for (unsigned int i=1; i < count; ++i)
+		{
+			const PlannedChannel current = channels[i];
+			unsigned int j = i;
+			while ((j > 0u) && (channels[j - 1u].channel->fileOffset > current.channel->fileOffset))
+			{
+				channels[j] = channels[j - 1u];
+				--j;
+			}
+			channels[j] = current;
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static unsigned int PlanReads(const PlannedChannel* channels, unsigned int channelCount, uint32_t maxGap, PlannedRead* reads)
+	{
+		unsigned int readCount = 0u;
+		for (unsigned int i=0; i < channelCount; ++i)
+		{
+			const Channel* channel = channels[i].channel;
+			const uint64_t channelEnd = channel->fileOffset + channel->size;
+
+			if (readCount != 0u)
+			{
+				// merge the channel into the previous read if the bytes in between are few enough to be read along
+				PlannedRead& read = reads[readCount - 1u];
+				const uint64_t readEnd = read.position + read.size;
+				const bool isNearby = (channel->fileOffset <= readEnd + maxGap);
+				const bool isSmallEnough = (channelEnd - read.position <= MAX_MERGED_READ_SIZE);
+				if (isNearby && isSmallEnough)
+				{
+					if (channelEnd > readEnd)
+					{
+						read.size = channelEnd - read.position;
+					}
+					++read.channelCount;
+					continue;
+				}
+			}
+
+			PlannedRead& read = reads[readCount++];
+			read.position = channel->fileOffset;
+			read.size = channel->size;
+			read.firstChannel = i;
+			read.channelCount = 1u;
+		}
+
+		return readCount;
+	}
 }
 
 
@@ -868,43 +1261,52 @@ LayerMaskSection* ParseLayerMaskSection(const Document* document, File* file, Al
 		return nullptr;
 	}
 
-	SyncFileReader reader(file);
+	SyncFileReader reader(file, allocator, SyncFileReader::DEFAULT_READ_AHEAD_SIZE);
 	reader.SetPosition(section.offset);
 
 	const uint32_t layerInfoSectionLength = fileUtil::ReadFromFileBE<uint32_t>(reader);
-	LayerMaskSection* layerMaskSection = ParseLayer(document, reader, allocator, section.offset, section.length, layerInfoSectionLength);
+	LayerMaskSection* layerMaskSection = ParseLayer(document, reader, allocator, section.offset, section.length, layerInfoSectionLength, nullptr);
 
 	// build the layer hierarchy
 	if (layerMaskSection && layerMaskSection->layers)
 	{
-		Layer* layerStack[256] = {};
-		layerStack[0] = nullptr;
-		int stackIndex = 0;
+		BuildLayerHierarchy(layerMaskSection);
+	}
 
-		for (unsigned int i=0; i < layerMaskSection->layerCount; ++i)
-		{
-			// note that it is much easier to build the hierarchy by traversing the layers backwards
-			Layer* layer = &layerMaskSection->layers[layerMaskSection->layerCount - i - 1u];
+	return layerMaskSection;
+}
 
-			PSD_ASSERT(stackIndex >= 0 && stackIndex < 256, "Stack index is out of bounds.");
-			layer->parent = layerStack[stackIndex];
 
-			unsigned int width = 0u;
-			unsigned int height = 0u;
-			GetExtents(layer, width, height);
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+LayerMaskSection* StreamLayerMaskSection(const Document* document, File* file, Allocator* allocator, StreamListener* listener)
+{
+	PSD_ASSERT_NOT_NULL(file);
+	PSD_ASSERT_NOT_NULL(allocator);
+	PSD_ASSERT_NOT_NULL(listener);
 
-			const bool isGroupStart = (layer->type == layerType::OPEN_FOLDER) || (layer->type == layerType::CLOSED_FOLDER);
-			const bool isGroupEnd = (layer->type == layerType::SECTION_DIVIDER);
-			if (isGroupEnd)
-			{
-				--stackIndex;
-			}
-			else if (isGroupStart)
-			{
-				++stackIndex;
-				layerStack[stackIndex] = layer;
-			}
+	const Section& section = document->layerMaskInfoSection;
+	if (section.length == 0)
+	{
+		PSD_ERROR("PSD", "Document does not contain a layer mask section.");
+		return nullptr;
+	}
+
+	// the records, channel data, and global layer mask info are read in file order by a single reader, holding
+	// the compressed data of at most one channel at a time.
+	SyncFileReader reader(file, allocator, SyncFileReader::DEFAULT_READ_AHEAD_SIZE);
+	reader.SetPosition(section.offset);
+
+	const uint32_t layerInfoSectionLength = fileUtil::ReadFromFileBE<uint32_t>(reader);
+	LayerMaskSection* layerMaskSection = ParseLayer(document, reader, allocator, section.offset, section.length, layerInfoSectionLength, listener);
+	if (reader.HasFailed())
+	{
+		PSD_ERROR("PSD", "Cannot read layer mask section, the file ends early.");
+		if (layerMaskSection)
+		{
+			DestroyLayerMaskSection(layerMaskSection, allocator);
 		}
+		return nullptr;
 	}
 
 	return layerMaskSection;
@@ -914,158 +1316,224 @@ LayerMaskSection* ParseLayerMaskSection(const Document* document, File* file, Al
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 void ExtractLayer(const Document* document, File* file, Allocator* allocator, Layer* layer)
+{
+	ExtractLayer(document, file, allocator, layer, nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void ExtractLayer(const Document* document, File* file, Allocator* allocator, Layer* layer, Executor* executor)
 {
 	PSD_ASSERT_NOT_NULL(file);
 	PSD_ASSERT_NOT_NULL(allocator);
 	PSD_ASSERT_NOT_NULL(layer);
 
-	SyncFileReader reader(file);
-
 	const unsigned int channelCount = layer->channelCount;
+
+	// the data of all channels is fetched using a single batch of reads, and decoded from memory afterwards. this is not
+	// needed if the file can hand out the data in-place anyway. layers too large for a single allocation are read one
+	// channel after the other through the read-ahead window instead, which keeps the peak memory bounded.
+	uint64_t layerDataBegin = 0ull;
+	uint64_t layerDataEnd = 0ull;
 	for (unsigned int i=0; i < channelCount; ++i)
 	{
-		Channel* channel = &layer->channels[i];
-		reader.SetPosition(channel->fileOffset);
-
-		unsigned int width = 0u;
-		unsigned int height = 0u;
-		GetChannelExtents(layer, channel, width, height);
-
-		// channel data is stored in 4 different formats, which is denoted by a 2-byte integer
-		PSD_ASSERT(channel->data == nullptr, "Channel data has already been loaded.");
-		const uint16_t compressionType = fileUtil::ReadFromFileBE<uint16_t>(reader);
-		if (compressionType == compressionType::RAW)
-		{
-			if (document->bitsPerChannel == 8)
-			{
-				channel->data = ReadChannelDataRaw<uint8_t>(reader, allocator, width, height);
-			}
-			else if (document->bitsPerChannel == 16)
-			{
-				channel->data = ReadChannelDataRaw<uint16_t>(reader, allocator, width, height);
-			}
-			else if (document->bitsPerChannel == 32)
-			{
-				channel->data = ReadChannelDataRaw<float32_t>(reader, allocator, width, height);
-			}
-		}
-		else if (compressionType == compressionType::RLE)
+		const Channel* channel = &layer->channels[i];
+		const uint64_t channelEnd = channel->fileOffset + channel->size;
+		if ((i == 0u) || (channel->fileOffset < layerDataBegin))
 		{
-			if (document->bitsPerChannel == 8)
-			{
-				channel->data = ReadChannelDataRLE<uint8_t>(reader, allocator, width, height);
-			}
-			else if (document->bitsPerChannel == 16)
-			{
-				channel->data = ReadChannelDataRLE<uint16_t>(reader, allocator, width, height);
-			}
-			else if (document->bitsPerChannel == 32)
-			{
-				channel->data = ReadChannelDataRLE<float32_t>(reader, allocator, width, height);
-			}
+			layerDataBegin = channel->fileOffset;
 		}
-		else if (compressionType == compressionType::ZIP)
+		if (channelEnd > layerDataEnd)
 		{
-			// note that we need to subtract 2 bytes from the channel data size because we already read the uint16_t
-			// for the compression type.
-			PSD_ASSERT(channel->size >= 2, "Invalid channel data size %d.", channel->size);
-			const uint32_t channelDataSize = channel->size - 2u;
-			if (document->bitsPerChannel == 8)
-			{
-				channel->data = ReadChannelDataZip<uint8_t>(reader, allocator, width, height, channelDataSize);
-			}
-			else if (document->bitsPerChannel == 16)
-			{
-				channel->data = ReadChannelDataZip<uint16_t>(reader, allocator, width, height, channelDataSize);
-			}
-			else if (document->bitsPerChannel == 32)
-			{
-				// note that this is NOT a bug.
-				// in 32-bit mode, Photoshop always interprets ZIP compression as being ZIP_WITH_PREDICTION, presumably to get better compression when writing files.
-				channel->data = ReadChannelDataZipPrediction<float32_t>(reader, allocator, width, height, channelDataSize);
-			}
+			layerDataEnd = channelEnd;
 		}
-		else if (compressionType == compressionType::ZIP_WITH_PREDICTION)
+	}
+
+	const uint64_t layerDataSize = layerDataEnd - layerDataBegin;
+	uint8_t* layerData = nullptr;
+	if ((layerDataSize != 0ull) && (layerDataSize <= MAX_MERGED_READ_SIZE) && !file->GetSpan(layerDataBegin, static_cast<uint32_t>(layerDataSize)))
+	{
+		layerData = static_cast<uint8_t*>(allocator->Allocate(static_cast<size_t>(layerDataSize), 16u));
+
+		File::ReadRequest* requests = memoryUtil::AllocateArray<File::ReadRequest>(allocator, channelCount);
+		for (unsigned int i=0; i < channelCount; ++i)
 		{
-			// note that we need to subtract 2 bytes from the channel data size because we already read the uint16_t
-			// for the compression type.
-			PSD_ASSERT(channel->size >= 2, "Invalid channel data size %d.", channel->size);
-			const uint32_t channelDataSize = channel->size - 2u;
-			if (document->bitsPerChannel == 8)
-			{
-				channel->data = ReadChannelDataZipPrediction<uint8_t>(reader, allocator, width, height, channelDataSize);
-			}
-			else if (document->bitsPerChannel == 16)
-			{
-				channel->data = ReadChannelDataZipPrediction<uint16_t>(reader, allocator, width, height, channelDataSize);
-			}
-			else if (document->bitsPerChannel == 32)
-			{
-				channel->data = ReadChannelDataZipPrediction<float32_t>(reader, allocator, width, height, channelDataSize);
-			}
+			const Channel* channel = &layer->channels[i];
+			requests[i].buffer = layerData + (channel->fileOffset - layerDataBegin);
+			requests[i].count = channel->size;
+			requests[i].position = channel->fileOffset;
 		}
-		else
+
+		const bool success = file->ReadBatch(requests, channelCount);
+		memoryUtil::FreeArray(allocator, requests);
+
+		if (!success)
 		{
-			PSD_ASSERT(false, "Unsupported compression type %d", compressionType);
+			// none of the channels are decoded from data that could not be read
+			PSD_ERROR("PsdExtract", "Cannot read channel data of layer.");
+			allocator->Free(layerData);
 			return;
 		}
+	}
 
-		// if the channel doesn't have any data assigned to it, check if it is a mask channel of any kind.
-		// layer masks sometimes don't have any planar data stored for them, because they are
-		// e.g. pure black or white, which means they only get assigned a default color.
-		if (!channel->data)
+	// positions are relative to the start of the layer data when decoding from memory
+	MemoryFile layerFile(allocator, layerData, layerData ? layerDataSize : 0ull);
+	const uint64_t positionOffset = layerData ? layerDataBegin : 0ull;
+	SyncFileReader reader(layerData ? &layerFile : file, allocator, layerData ? 0u : SyncFileReader::DEFAULT_READ_AHEAD_SIZE);
+
+	for (unsigned int i=0; i < channelCount; ++i)
+	{
+		Channel* channel = &layer->channels[i];
+		reader.SetPosition(channel->fileOffset - positionOffset);
+
+		if (!ExtractChannel(document, reader, allocator, executor, layer, channel))
 		{
-			if (channel->type < 0)
-			{
-				// this is a layer mask, so create planar data for it
-				const size_t dataSize = width * height * document->bitsPerChannel / 8u;
-				void* channelData = allocator->Allocate(dataSize, 16u);
-				memset(channelData, GetChannelDefaultColor(layer, channel), dataSize);
-				channel->data = channelData;
-			}
-			else
+			if (layerData)
 			{
-				// for layers like groups and group end markers ("</Layer group>") it is ok to not store any data
+				allocator->Free(layerData);
 			}
+			return;
 		}
 	}
 
+	if (layerData)
+	{
+		allocator->Free(layerData);
+	}
+
 	// now move channel data to our own data structures for layer and vector masks, invalidating the info stored in
 	// that channel.
-	for (unsigned int i=0; i < channelCount; ++i)
+	MoveChannelsToMasks(layer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void ExtractLayers(const Document* document, File* file, Allocator* allocator, Layer* const* layers, unsigned int layerCount)
+{
+	ExtractLayers(document, file, allocator, layers, layerCount, DEFAULT_MAX_READ_GAP);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void ExtractLayers(const Document* document, File* file, Allocator* allocator, Layer* const* layers, unsigned int layerCount, uint32_t maxGap)
+{
+	PSD_ASSERT_NOT_NULL(file);
+	PSD_ASSERT_NOT_NULL(allocator);
+	PSD_ASSERT((layers != nullptr) || (layerCount == 0u), "Extracting %u layers without layers.", layerCount);
+
+	unsigned int channelCount = 0u;
+	for (unsigned int i=0; i < layerCount; ++i)
 	{
-		Channel* channel = &layer->channels[i];
-		if (channel->type == channelType::LAYER_OR_VECTOR_MASK)
+		channelCount += layers[i]->channelCount;
+	}
+
+	if (channelCount == 0u)
+		return;
+
+	// gather the channels of all layers in file order, and merge the ones lying close to each other into a single read
+	PlannedChannel* channels = memoryUtil::AllocateArray<PlannedChannel>(allocator, channelCount);
+	unsigned int channelIndex = 0u;
+	for (unsigned int i=0; i < layerCount; ++i)
+	{
+		Layer* layer = layers[i];
+		for (unsigned int j=0; j < layer->channelCount; ++j)
 		{
-			if (layer->vectorMask)
-			{
-				// layer has a vector mask, so this type always denotes the vector mask
-				PSD_ASSERT(!layer->vectorMask->data, "Vector mask data has already been assigned.");
-				MoveChannelToMask(channel, layer->vectorMask);
-			}
-			else if (layer->layerMask)
+			channels[channelIndex].layer = layer;
+			channels[channelIndex].channel = &layer->channels[j];
+			channels[channelIndex].layerIndex = i;
+			++channelIndex;
+		}
+	}
+
+	SortChannelsByOffset(channels, channelCount);
+
+	PlannedRead* reads = memoryUtil::AllocateArray<PlannedRead>(allocator, channelCount);
+	const unsigned int readCount = PlanReads(channels, channelCount, maxGap, reads);
+
+	// all reads are announced up front, so that the OS can fetch later ones in the background while earlier ones are decoded
+	uint64_t maxReadSize = 0ull;
+	for (unsigned int i=0; i < readCount; ++i)
+	{
+		file->Prefetch(reads[i].position, reads[i].size);
+		if (reads[i].size > maxReadSize)
+		{
+			maxReadSize = reads[i].size;
+		}
+	}
+
+	// channels are decoded in file order, so all channels in front of the first failed one have been decoded
+	uint8_t* readData = nullptr;
+	unsigned int extractedChannelCount = 0u;
+	bool success = true;
+	for (unsigned int i=0; (i < readCount) && success; ++i)
+	{
+		const PlannedRead& read = reads[i];
+
+		// data the file can hand out in-place is decoded directly from the file
+		const uint32_t readSize = static_cast<uint32_t>(read.size);
+		const bool isInPlace = (file->GetSpan(read.position, readSize) != nullptr);
+		if (!isInPlace)
+		{
+			if (!readData)
 			{
-				// we don't have a vector but a layer mask, so this type denotes the layer mask
-				PSD_ASSERT(!layer->layerMask->data, "Layer mask data has already been assigned.");
-				MoveChannelToMask(channel, layer->layerMask);
+				readData = static_cast<uint8_t*>(allocator->Allocate(static_cast<size_t>(maxReadSize), 16u));
 			}
-			else
+
+			if (!file->ReadSync(readData, readSize, read.position))
 			{
-				PSD_ASSERT(false, "The code failed to create a mask for this type internally. This should never happen.");
+				PSD_ERROR("PsdExtract", "Cannot read %u bytes of channel data from file position %" PRIu64 ".", readSize, read.position);
+				success = false;
+				break;
 			}
 		}
-		else if (channel->type == channelType::LAYER_MASK)
+
+		// positions are relative to the start of the read when decoding from memory
+		MemoryFile readFile(allocator, readData, isInPlace ? 0ull : read.size);
+		const uint64_t positionOffset = isInPlace ? 0ull : read.position;
+		SyncFileReader reader(isInPlace ? file : &readFile, allocator, isInPlace ? SyncFileReader::DEFAULT_READ_AHEAD_SIZE : 0u);
+
+		for (unsigned int j=0; j < read.channelCount; ++j)
 		{
-			PSD_ASSERT(layer->layerMask, "Layer mask must already exist.");
-			PSD_ASSERT(!layer->layerMask->data, "Layer mask data has already been assigned.");
-			MoveChannelToMask(channel, layer->layerMask);
+			const PlannedChannel& planned = channels[read.firstChannel + j];
+			reader.SetPosition(planned.channel->fileOffset - positionOffset);
+
+			if (!ExtractChannel(document, reader, allocator, nullptr, planned.layer, planned.channel))
+			{
+				success = false;
+				break;
+			}
+
+			++extractedChannelCount;
 		}
-		else
+	}
+
+	// layers that were decoded in full end up like the ones extracted by ExtractLayer, even if other layers failed
+	bool* isLayerComplete = memoryUtil::AllocateArray<bool>(allocator, layerCount);
+	for (unsigned int i=0; i < layerCount; ++i)
+	{
+		isLayerComplete[i] = true;
+	}
+
+	for (unsigned int i=extractedChannelCount; i < channelCount; ++i)
+	{
+		isLayerComplete[channels[i].layerIndex] = false;
+	}
+
+	for (unsigned int i=0; i < layerCount; ++i)
+	{
+		if (isLayerComplete[i])
 		{
-			// this channel is either a color channel, or the transparency mask. those should be stored in our channel array,
-			// so there's nothing to do.
+			MoveChannelsToMasks(layers[i]);
 		}
 	}
+
+	memoryUtil::FreeArray(allocator, isLayerComplete);
+	allocator->Free(readData);
+	memoryUtil::FreeArray(allocator, reads);
+	memoryUtil::FreeArray(allocator, channels);
 }
 
 
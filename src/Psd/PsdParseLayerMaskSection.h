@@ -11,6 +11,8 @@ class File;
 class Allocator;
 struct Layer;
 struct LayerMaskSection;
+class StreamListener;
+class Executor;
 
 
 /// \ingroup Parser
@@ -21,11 +23,43 @@ struct LayerMaskSection;
 /// or \ref ParseLayerMaskSection) in parallel from different threads.
 LayerMaskSection* ParseLayerMaskSection(const Document* document, File* file, Allocator* allocator);
 
+/// \ingroup Parser
+/// Parses the layer mask section in the document in a single forward pass, and returns a newly created instance that needs to
+/// be freed by a call to \ref DestroyLayerMaskSection. The records of all layers and the decoded data of each channel are
+/// handed to the \a listener in file order, so that the file never needs to seek backwards. Returns a nullptr if the section
+/// cannot be read completely, e.g. because the file ends early.
+/// \remark The returned layers do not hold any channel data, because the data is freed after being handed to the listener.
+/// \sa StreamDocument
+LayerMaskSection* StreamLayerMaskSection(const Document* document, File* file, Allocator* allocator, StreamListener* listener);
+
 /// \ingroup Parser
 /// Extracts data for a given \a layer.
 /// \remark It is valid and suggested to extract the data of individual layers from multiple threads in parallel.
 void ExtractLayer(const Document* document, File* file, Allocator* allocator, Layer* layer);
 
+/// \ingroup Parser
+/// Extracts data for a given \a layer like \ref ExtractLayer, but decompresses RLE-compressed channels using the given
+/// \a executor. The rows of each channel are split into ranges that are decompressed as separate tasks, which helps
+/// with single layers that are too large to be decompressed quickly on one thread.
+/// \sa imageUtil::DecompressRleRows
+void ExtractLayer(const Document* document, File* file, Allocator* allocator, Layer* layer, Executor* executor);
+
+/// \ingroup Parser
+/// Extracts data for all \a layerCount given \a layers, allowing gaps of up to 64 KB between channels that are read together.
+/// \sa ExtractLayers(const Document*, File*, Allocator*, Layer* const*, unsigned int, uint32_t)
+void ExtractLayers(const Document* document, File* file, Allocator* allocator, Layer* const* layers, unsigned int layerCount);
+
+/// \ingroup Parser
+/// Extracts data for all \a layerCount given \a layers using as few reads as possible. The channel data of consecutive layers
+/// is stored back-to-back in the file, so the channels of all layers are sorted by file offset, and channels lying at most
+/// \a maxGap bytes apart are fetched using a single read that includes the bytes in between. All planned reads are announced
+/// to the file using \ref File::Prefetch before the first one is issued, and channels are decoded in file order.
+/// \remark Compared to calling \ref ExtractLayer for each layer, this turns many small reads into a few large sequential ones,
+/// which pays off most on storage with high access latency, such as hard disks or network file systems.
+/// \remark If reading or decoding fails partway through, only the layers whose channels were all decoded end up like
+/// they would after a call to \ref ExtractLayer. The data of the remaining layers is incomplete.
+void ExtractLayers(const Document* document, File* file, Allocator* allocator, Layer* const* layers, unsigned int layerCount, uint32_t maxGap);
+
 /// \ingroup Parser
 /// Destroys and nullifies the given \a section previously created by a call to \ref ParseLayerMaskSection.
 void DestroyLayerMaskSection(LayerMaskSection*& section, Allocator* allocator);
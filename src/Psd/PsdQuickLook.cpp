@@ -0,0 +1,262 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdQuickLook.h"
+
+#include "PsdQuickLookInfo.h"
+#include "PsdImageResourceType.h"
+#include "PsdEndianConversion.h"
+#include "PsdAssert.h"
+#include "PsdBitUtil.h"
+#include "PsdKey.h"
+#include "PsdAllocator.h"
+#include "PsdFile.h"
+#include "PsdLog.h"
+#include "Psdinttypes.h"
+#include <cstring>
+
+
+PSD_NAMESPACE_BEGIN
+
+namespace
+{
+	static const uint32_t WINDOW_SIZE = 16u * 1024u;
+	static const uint32_t HEADER_SIZE = 26u;
+
+	// size of the fields in front of the JFIF data in the thumbnail resource
+	static const uint32_t THUMBNAIL_HEADER_SIZE = 28u;
+
+	// format of thumbnails stored as JFIF data (kJpegRGB), as opposed to raw RGB data (kRawRGB)
+	static const uint32_t THUMBNAIL_FORMAT_JPEG = 1u;
+
+	// the thumbnail data directly follows the info, keeping the alignment guaranteed by the allocator
+	static const size_t INFO_SIZE = (sizeof(QuickLookInfo) + 15u) & ~static_cast<size_t>(15u);
+
+
+	// a window into the file, serving small reads from a buffer on the stack
+	struct Window
+	{
+		File* file;
+		uint64_t fileSize;
+		uint64_t position;
+		uint32_t size;
+		uint8_t data[WINDOW_SIZE];
+	};
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static const uint8_t* Fetch(Window& window, uint64_t position, uint32_t count)
+	{
+		PSD_ASSERT(count <= WINDOW_SIZE, "Cannot fetch %u bytes through the window.", count);
+
+		if ((position > window.fileSize) || (count > window.fileSize - position))
+		{
+			PSD_ERROR("QuickLook", "Cannot read %u bytes from file position %" PRIu64 ", file size is %" PRIu64 ".", count, position, window.fileSize);
+			return nullptr;
+		}
+
+		const void* span = window.file->GetSpan(position, count);
+		if (span)
+			return static_cast<const uint8_t*>(span);
+
+		if ((position < window.position) || (position + count > window.position + window.size))
+		{
+			// move the window so that it starts at the requested position
+			const uint64_t remaining = window.fileSize - position;
+			const uint32_t size = (remaining < WINDOW_SIZE) ? static_cast<uint32_t>(remaining) : WINDOW_SIZE;
+			if (!window.file->ReadSync(window.data, size, position))
+			{
+				window.size = 0u;
+				return nullptr;
+			}
+
+			window.position = position;
+			window.size = size;
+		}
+
+		return window.data + (position - window.position);
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename T>
+	static T ReadBE(const uint8_t* data)
+	{
+		T value;
+		memcpy(&value, data, sizeof(T));
+		return endianUtil::BigEndianToNative(value);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+QuickLookInfo* QuickLook(File* file, Allocator* allocator)
+{
+	PSD_ASSERT_NOT_NULL(file);
+	PSD_ASSERT_NOT_NULL(allocator);
+
+	Window window;
+	window.file = file;
+	window.fileSize = file->GetSize();
+	window.position = 0ull;
+	window.size = 0u;
+
+	// the header is followed by the length of the color mode data section
+	const uint8_t* header = Fetch(window, 0ull, HEADER_SIZE + sizeof(uint32_t));
+	if (!header)
+		return nullptr;
+
+	if (ReadBE<uint32_t>(header) != util::Key<'8', 'B', 'P', 'S'>::VALUE)
+	{
+		PSD_ERROR("QuickLook", "File seems to be corrupt, signature does not match \"8BPS\".");
+		return nullptr;
+	}
+
+	if (ReadBE<uint16_t>(header + 4u) != 1u)
+	{
+		PSD_ERROR("QuickLook", "File seems to be corrupt, version does not match 1.");
+		return nullptr;
+	}
+
+	const uint8_t zeroes[6] = {};
+	if (memcmp(header + 6u, zeroes, sizeof(zeroes)) != 0)
+	{
+		PSD_ERROR("QuickLook", "File seems to be corrupt, reserved bytes are not zero.");
+		return nullptr;
+	}
+
+	const unsigned int channelCount = ReadBE<uint16_t>(header + 12u);
+	const unsigned int height = ReadBE<uint32_t>(header + 14u);
+	const unsigned int width = ReadBE<uint32_t>(header + 18u);
+	const unsigned int bitsPerChannel = ReadBE<uint16_t>(header + 22u);
+	const unsigned int colorMode = ReadBE<uint16_t>(header + 24u);
+	const uint32_t colorModeDataLength = ReadBE<uint32_t>(header + HEADER_SIZE);
+
+	// walk the headers of all image resources up to the thumbnail, without touching the data of any other resource
+	uint64_t thumbnailPosition = 0ull;
+	uint32_t thumbnailWidth = 0u;
+	uint32_t thumbnailHeight = 0u;
+	uint32_t binaryJpegSize = 0u;
+
+	const uint64_t sectionPosition = HEADER_SIZE + sizeof(uint32_t) + colorModeDataLength;
+	const uint8_t* sectionLength = Fetch(window, sectionPosition, sizeof(uint32_t));
+	if (sectionLength)
+	{
+		uint64_t position = sectionPosition + sizeof(uint32_t);
+		const uint64_t sectionEnd = position + ReadBE<uint32_t>(sectionLength);
+
+		// signature, ID, and the length of the resource name
+		const uint32_t resourceHeaderSize = 7u;
+		while (position + resourceHeaderSize <= sectionEnd)
+		{
+			const uint8_t* resourceHeader = Fetch(window, position, resourceHeaderSize);
+			if (!resourceHeader)
+				break;
+
+			const uint32_t signature = ReadBE<uint32_t>(resourceHeader);
+			if ((signature != util::Key<'8', 'B', 'I', 'M'>::VALUE) && (signature != util::Key<'p', 's', 'd', 'M'>::VALUE))
+			{
+				PSD_ERROR("QuickLook", "Image resources section seems to be corrupt, signature does not match \"8BIM\".");
+				break;
+			}
+
+			const uint16_t id = ReadBE<uint16_t>(resourceHeader + 4u);
+
+			// the resource name is stored as a Pascal string, padded to make the size even
+			const uint32_t paddedNameLength = bitUtil::RoundUpToMultiple(resourceHeader[6] + 1u, 2u);
+			const uint64_t sizePosition = position + 6u + paddedNameLength;
+			const uint8_t* resourceSize = Fetch(window, sizePosition, sizeof(uint32_t));
+			if (!resourceSize)
+				break;
+
+			const uint32_t size = ReadBE<uint32_t>(resourceSize);
+			const uint64_t dataPosition = sizePosition + sizeof(uint32_t);
+			if (id == imageResource::THUMBNAIL_RESOURCE)
+			{
+				const uint8_t* thumbnailHeader = (size >= THUMBNAIL_HEADER_SIZE) ? Fetch(window, dataPosition, THUMBNAIL_HEADER_SIZE) : nullptr;
+				if (thumbnailHeader && (ReadBE<uint32_t>(thumbnailHeader) != THUMBNAIL_FORMAT_JPEG))
+				{
+					PSD_WARNING("QuickLook", "Thumbnail is not stored as JFIF data, and is ignored.");
+				}
+				else if (thumbnailHeader)
+				{
+					thumbnailWidth = ReadBE<uint32_t>(thumbnailHeader + 4u);
+					thumbnailHeight = ReadBE<uint32_t>(thumbnailHeader + 8u);
+					binaryJpegSize = ReadBE<uint32_t>(thumbnailHeader + 20u);
+					thumbnailPosition = dataPosition + THUMBNAIL_HEADER_SIZE;
+
+					if (binaryJpegSize > size - THUMBNAIL_HEADER_SIZE)
+					{
+						PSD_ERROR("QuickLook", "Thumbnail seems to be corrupt, JPEG data of %u bytes does not fit into the resource.", binaryJpegSize);
+						binaryJpegSize = 0u;
+					}
+				}
+				break;
+			}
+
+			// the resource data size is also padded to make the size even
+			position = dataPosition + bitUtil::RoundUpToMultiple(size, 2u);
+		}
+	}
+
+	QuickLookInfo* info = static_cast<QuickLookInfo*>(allocator->Allocate(INFO_SIZE + binaryJpegSize, 16u));
+	info->width = width;
+	info->height = height;
+	info->channelCount = channelCount;
+	info->bitsPerChannel = bitsPerChannel;
+	info->colorMode = colorMode;
+	info->thumbnailWidth = 0u;
+	info->thumbnailHeight = 0u;
+	info->binaryJpegSize = 0u;
+	info->binaryJpeg = nullptr;
+
+	if (binaryJpegSize != 0u)
+	{
+		uint8_t* binaryJpeg = reinterpret_cast<uint8_t*>(info) + INFO_SIZE;
+
+		// the JPEG data is usually either part of the window already, or read with one more read
+		const void* span = file->GetSpan(thumbnailPosition, binaryJpegSize);
+		const bool isInWindow = (thumbnailPosition >= window.position) && (thumbnailPosition + binaryJpegSize <= window.position + window.size);
+		bool success = true;
+		if (span)
+		{
+			memcpy(binaryJpeg, span, binaryJpegSize);
+		}
+		else if (isInWindow)
+		{
+			memcpy(binaryJpeg, window.data + (thumbnailPosition - window.position), binaryJpegSize);
+		}
+		else
+		{
+			success = file->ReadSync(binaryJpeg, binaryJpegSize, thumbnailPosition);
+		}
+
+		if (success)
+		{
+			info->thumbnailWidth = thumbnailWidth;
+			info->thumbnailHeight = thumbnailHeight;
+			info->binaryJpegSize = binaryJpegSize;
+			info->binaryJpeg = binaryJpeg;
+		}
+	}
+
+	return info;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void DestroyQuickLook(QuickLookInfo*& info, Allocator* allocator)
+{
+	PSD_ASSERT_NOT_NULL(info);
+	PSD_ASSERT_NOT_NULL(allocator);
+
+	allocator->Free(info);
+	info = nullptr;
+}
+
+PSD_NAMESPACE_END
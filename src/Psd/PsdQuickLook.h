@@ -0,0 +1,29 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+class File;
+class Allocator;
+struct QuickLookInfo;
+
+
+/// \ingroup Parser
+/// Reads only the header and the embedded thumbnail of a document, and returns a newly created instance that needs to be
+/// freed by a call to \ref DestroyQuickLook, or a nullptr if the file is not a valid document.
+/// \details Unlike \ref CreateDocument followed by \ref ParseImageResourcesSection, no other image resource is loaded. The
+/// header and the headers of the image resources in front of the thumbnail are read through a small window on the stack, and
+/// the thumbnail data is stored right behind the returned struct in the only allocation made. When the thumbnail resource
+/// starts within the first 16 KB of the file, which is the common case, at most two reads are issued. No reads are issued
+/// at all for files offering direct access via \ref File::GetSpan.
+/// \remark Only thumbnails stored in the \ref imageResource::THUMBNAIL_RESOURCE format (JFIF data) are returned.
+QuickLookInfo* QuickLook(File* file, Allocator* allocator);
+
+/// \ingroup Parser
+/// Destroys and nullifies the given \a info previously created by a call to \ref QuickLook.
+void DestroyQuickLook(QuickLookInfo*& info, Allocator* allocator);
+
+PSD_NAMESPACE_END
@@ -0,0 +1,28 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Types
+/// \class QuickLookInfo
+/// \brief A struct storing the header fields and the embedded thumbnail of a .PSD file, as returned by \ref QuickLook.
+/// \details The struct and the thumbnail data are stored in a single allocation.
+/// \sa QuickLook DestroyQuickLook
+struct QuickLookInfo
+{
+	unsigned int width;							///< The width of the document.
+	unsigned int height;						///< The height of the document.
+	unsigned int channelCount;					///< The number of channels stored in the document, including any additional alpha channels.
+	unsigned int bitsPerChannel;				///< The bits per channel (8, 16 or 32).
+	unsigned int colorMode;						///< The color mode the document is stored in, can be any of \ref colorMode::Enum.
+
+	uint32_t thumbnailWidth;					///< The width of the thumbnail, or zero if the document does not store a thumbnail.
+	uint32_t thumbnailHeight;					///< The height of the thumbnail, or zero if the document does not store a thumbnail.
+	uint32_t binaryJpegSize;					///< The size of the JFIF data of the thumbnail in bytes.
+	const uint8_t* binaryJpeg;					///< The JFIF data of the thumbnail, or a nullptr if the document does not store a thumbnail.
+};
+
+PSD_NAMESPACE_END
@@ -0,0 +1,474 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdRangeFetchFile.h"
+
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAssert.h"
+#include "PsdLog.h"
+#include "Psdinttypes.h"
+#include <condition_variable>
+#include <mutex>
+#include <cstring>
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+RangeFetcher::~RangeFetcher(void)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetcher::Fetch(void* buffer, uint32_t count, uint64_t position)
+{
+	return DoFetch(buffer, count, position);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t RangeFetcher::GetSize(void) const
+{
+	return DoGetSize();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct RangeFetchFile::Block
+{
+	enum State
+	{
+		EMPTY,					// slot does not hold any block
+		LOADING,				// block is being fetched, readers have to wait
+		READY,					// block holds valid data
+		FAILED					// fetching the block failed, slot can be reused
+	};
+
+	uint8_t* data;
+	uint64_t index;
+	uint64_t lastUse;
+	uint32_t size;
+	unsigned int refCount;
+	State state;
+};
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct RangeFetchFile::Cache
+{
+	std::mutex mutex;
+	std::condition_variable loaded;
+
+	uint8_t* memory;
+	Block* blocks;
+	uint32_t blockSize;
+	unsigned int blockCount;
+	unsigned int prefetchCount;
+	uint64_t tick;
+
+	Statistics statistics;
+};
+
+
+namespace
+{
+	typedef std::unique_lock<std::mutex> CacheLock;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Block>
+	static Block* FindBlock(Block* blocks, unsigned int blockCount, uint64_t index)
+	{
+		for (unsigned int i = 0u; i < blockCount; ++i)
+		{
+			Block* block = &blocks[i];
+			if ((block->index == index) && ((block->state == Block::LOADING) || (block->state == Block::READY)))
+				return block;
+		}
+
+		return nullptr;
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Block>
+	static Block* FindVictim(Block* blocks, unsigned int blockCount)
+	{
+		// empty and failed slots have never been used, so they are picked before any valid block
+		Block* victim = nullptr;
+		for (unsigned int i = 0u; i < blockCount; ++i)
+		{
+			Block* block = &blocks[i];
+			if ((block->refCount != 0u) || (block->state == Block::LOADING))
+				continue;
+
+			if (!victim || (block->lastUse < victim->lastUse))
+			{
+				victim = block;
+			}
+		}
+
+		return victim;
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+RangeFetchFile::RangeFetchFile(Allocator* allocator, RangeFetcher* fetcher)
+	: File(allocator)
+	, m_fetcher(fetcher)
+	, m_size(fetcher->GetSize())
+	, m_cache(nullptr)
+{
+	Initialize(DEFAULT_BLOCK_SIZE, DEFAULT_BLOCK_COUNT, DEFAULT_PREFETCH_COUNT);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+RangeFetchFile::RangeFetchFile(Allocator* allocator, RangeFetcher* fetcher, uint32_t blockSize, unsigned int blockCount, unsigned int prefetchCount)
+	: File(allocator)
+	, m_fetcher(fetcher)
+	, m_size(fetcher->GetSize())
+	, m_cache(nullptr)
+{
+	Initialize(blockSize, blockCount, prefetchCount);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+RangeFetchFile::~RangeFetchFile(void)
+{
+	if (m_cache)
+	{
+		m_allocator->Free(m_cache->memory);
+		memoryUtil::FreeArray(m_allocator, m_cache->blocks);
+		memoryUtil::Free(m_allocator, m_cache);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+RangeFetchFile::Statistics RangeFetchFile::GetStatistics(void) const
+{
+	CacheLock lock(m_cache->mutex);
+	return m_cache->statistics;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void RangeFetchFile::Initialize(uint32_t blockSize, unsigned int blockCount, unsigned int prefetchCount)
+{
+	PSD_ASSERT(blockSize != 0u, "Block size must not be zero.");
+	PSD_ASSERT(blockCount != 0u, "Block count must not be zero.");
+
+	if (prefetchCount > MAX_PREFETCH_COUNT)
+	{
+		PSD_WARNING("RangeFetchFile", "Prefetch count %u is too large, using %u instead.", prefetchCount, MAX_PREFETCH_COUNT);
+		prefetchCount = MAX_PREFETCH_COUNT;
+	}
+
+	Cache* cache = memoryUtil::Allocate<Cache>(m_allocator);
+	cache->memory = static_cast<uint8_t*>(m_allocator->Allocate(static_cast<size_t>(blockSize) * blockCount, 16u));
+	cache->blocks = memoryUtil::AllocateArray<Block>(m_allocator, blockCount);
+	cache->blockSize = blockSize;
+	cache->blockCount = blockCount;
+	cache->prefetchCount = prefetchCount;
+	cache->tick = 0ull;
+	memset(&cache->statistics, 0, sizeof(Statistics));
+
+	for (unsigned int i = 0u; i < blockCount; ++i)
+	{
+		Block& block = cache->blocks[i];
+		block.data = cache->memory + static_cast<size_t>(blockSize) * i;
+		block.index = 0ull;
+		block.lastUse = 0ull;
+		block.size = 0u;
+		block.refCount = 0u;
+		block.state = Block::EMPTY;
+	}
+
+	m_cache = cache;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::FetchRange(void* buffer, uint32_t count, uint64_t position)
+{
+	const bool success = m_fetcher->Fetch(buffer, count, position);
+	if (!success)
+	{
+		PSD_ERROR("RangeFetchFile", "Cannot fetch %u bytes from file position %" PRIu64 ".", count, position);
+	}
+
+	CacheLock lock(m_cache->mutex);
+	++m_cache->statistics.fetchCount;
+	m_cache->statistics.fetchedBytes += count;
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::AcquireBlock(uint64_t blockIndex, Block*& block)
+{
+	Cache* cache = m_cache;
+	CacheLock lock(cache->mutex);
+
+	Block* found = FindBlock(cache->blocks, cache->blockCount, blockIndex);
+	if (found)
+	{
+		// hold a reference so that the block cannot be evicted while waiting or copying from it
+		++found->refCount;
+
+		if (found->state == Block::LOADING)
+		{
+			++cache->statistics.coalescedCount;
+			cache->loaded.wait(lock, [found]() { return found->state != Block::LOADING; });
+
+			if (found->state != Block::READY)
+			{
+				--found->refCount;
+				return false;
+			}
+		}
+		else
+		{
+			++cache->statistics.hitCount;
+		}
+
+		found->lastUse = ++cache->tick;
+		block = found;
+		return true;
+	}
+
+	++cache->statistics.missCount;
+
+	// claim a slot for the requested block, and slots for as many of the following blocks as are not cached yet
+	Block* claimed[MAX_PREFETCH_COUNT + 1u] = {};
+	unsigned int claimedCount = 0u;
+
+	const uint64_t totalBlockCount = (m_size + cache->blockSize - 1u) / cache->blockSize;
+	for (unsigned int i = 0u; i <= cache->prefetchCount; ++i)
+	{
+		const uint64_t index = blockIndex + i;
+		if (index >= totalBlockCount)
+			break;
+
+		if ((i != 0u) && FindBlock(cache->blocks, cache->blockCount, index))
+			break;
+
+		Block* victim = FindVictim(cache->blocks, cache->blockCount);
+		if (!victim)
+			break;
+
+		const uint64_t position = index * cache->blockSize;
+		victim->index = index;
+		victim->size = (m_size - position < cache->blockSize) ? static_cast<uint32_t>(m_size - position) : cache->blockSize;
+		victim->refCount = 0u;
+		victim->state = Block::LOADING;
+		claimed[claimedCount++] = victim;
+	}
+
+	if (claimedCount == 0u)
+	{
+		// all blocks are in use, the caller has to fetch the data without going through the cache
+		block = nullptr;
+		return true;
+	}
+
+	claimed[0]->refCount = 1u;
+
+	uint64_t fetchSize = 0ull;
+	for (unsigned int i = 0u; i < claimedCount; ++i)
+	{
+		fetchSize += claimed[i]->size;
+	}
+
+	lock.unlock();
+
+	// all claimed blocks are fetched using a single request, staging the data if it has to be distributed to several slots
+	bool success = false;
+	if (claimedCount == 1u)
+	{
+		success = FetchRange(claimed[0]->data, claimed[0]->size, blockIndex * cache->blockSize);
+	}
+	else
+	{
+		uint8_t* staging = static_cast<uint8_t*>(m_allocator->Allocate(static_cast<size_t>(fetchSize), 16u));
+		success = FetchRange(staging, static_cast<uint32_t>(fetchSize), blockIndex * cache->blockSize);
+		if (success)
+		{
+			const uint8_t* source = staging;
+			for (unsigned int i = 0u; i < claimedCount; ++i)
+			{
+				memcpy(claimed[i]->data, source, claimed[i]->size);
+				source += claimed[i]->size;
+			}
+		}
+
+		m_allocator->Free(staging);
+	}
+
+	lock.lock();
+
+	for (unsigned int i = 0u; i < claimedCount; ++i)
+	{
+		claimed[i]->state = success ? Block::READY : Block::FAILED;
+		claimed[i]->lastUse = success ? ++cache->tick : 0ull;
+	}
+
+	cache->loaded.notify_all();
+
+	if (!success)
+	{
+		--claimed[0]->refCount;
+		return false;
+	}
+
+	block = claimed[0];
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void RangeFetchFile::ReleaseBlock(Block* block)
+{
+	CacheLock lock(m_cache->mutex);
+	--block->refCount;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::DoOpenRead(const wchar_t*)
+{
+	PSD_ERROR("RangeFetchFile", "Range-fetch files cannot be opened by name.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::DoOpenWrite(const wchar_t*)
+{
+	PSD_ERROR("RangeFetchFile", "Range-fetch files cannot be opened by name.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::DoClose(void)
+{
+	// cached blocks stay valid, so the file can still be read after closing it
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation RangeFetchFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	if (!DoReadSync(buffer, count, position))
+		return nullptr;
+
+	// the read has already finished, so any non-null object will do
+	return static_cast<File::ReadOperation>(buffer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::DoWaitForRead(File::ReadOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation RangeFetchFile::DoWrite(const void*, uint32_t, uint64_t)
+{
+	PSD_ERROR("RangeFetchFile", "Range-fetch files cannot be written to.");
+	return nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::DoWaitForWrite(File::WriteOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool RangeFetchFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	if (count == 0u)
+		return true;
+
+	if ((position > m_size) || (count > m_size - position))
+	{
+		PSD_ERROR("RangeFetchFile", "Cannot read %u bytes from file position %" PRIu64 ", file size is %" PRIu64 ".", count, position, m_size);
+		return false;
+	}
+
+	const uint32_t blockSize = m_cache->blockSize;
+	uint8_t* destination = static_cast<uint8_t*>(buffer);
+	while (count != 0u)
+	{
+		const uint64_t blockIndex = position / blockSize;
+		const uint32_t offset = static_cast<uint32_t>(position - blockIndex * blockSize);
+		const uint32_t toCopy = (blockSize - offset < count) ? (blockSize - offset) : count;
+
+		Block* block = nullptr;
+		if (!AcquireBlock(blockIndex, block))
+			return false;
+
+		if (block)
+		{
+			memcpy(destination, block->data + offset, toCopy);
+			ReleaseBlock(block);
+		}
+		else if (!FetchRange(destination, toCopy, position))
+		{
+			return false;
+		}
+
+		destination += toCopy;
+		position += toCopy;
+		count -= toCopy;
+	}
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t RangeFetchFile::DoGetSize(void) const
+{
+	return m_size;
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,117 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Interfaces
+/// \ingroup Files
+/// \brief Base class for fetching byte ranges of a file stored elsewhere, e.g. in an object store.
+/// \details Implementations are called by \ref RangeFetchFile from any thread that reads from the file, possibly concurrently.
+/// \sa RangeFetchFile
+class RangeFetcher
+{
+public:
+	/// Empty destructor.
+	virtual ~RangeFetcher(void);
+
+	/// Fetches count bytes starting at position into the buffer, and returns whether the operation was successful.
+	bool Fetch(void* buffer, uint32_t count, uint64_t position);
+
+	/// Returns the size of the file.
+	uint64_t GetSize(void) const;
+
+private:
+	virtual bool DoFetch(void* buffer, uint32_t count, uint64_t position) PSD_ABSTRACT;
+	virtual uint64_t DoGetSize(void) const PSD_ABSTRACT;
+};
+
+
+/// \ingroup Files
+/// \brief Read-only file implementation that fetches byte ranges using a \ref RangeFetcher, caching them in fixed-size blocks.
+/// \details Only the blocks touched by reads are ever fetched, which makes it possible to parse e.g. the layer records and
+/// a single layer of a large file without downloading all of it.
+///
+/// Blocks are held in a cache of a fixed number of blocks, evicting the least recently used ones. Whenever a block has to
+/// be fetched, the following blocks that are not cached yet are fetched along with it using a single, larger range request.
+/// Concurrent reads of a block that is currently being fetched wait for that fetch, rather than issuing their own.
+///
+/// Files are open as soon as they are constructed, hence OpenRead() and OpenWrite() always fail. All operations are
+/// synchronous, and the file cannot be written to. Fetches spanning several blocks are staged in memory obtained from the
+/// allocator, which therefore must be thread-safe if the file is read from several threads.
+/// \sa File RangeFetcher
+class RangeFetchFile : public File
+{
+public:
+	/// Cache statistics, see GetStatistics().
+	struct Statistics
+	{
+		uint64_t hitCount;			///< Number of block accesses served from the cache.
+		uint64_t missCount;			///< Number of block accesses that had to fetch the block.
+		uint64_t coalescedCount;	///< Number of block accesses that waited for a fetch issued by another read.
+		uint64_t fetchCount;		///< Number of range requests issued to the fetcher.
+		uint64_t fetchedBytes;		///< Number of bytes fetched in total.
+	};
+
+	/// Default size of a block.
+	static const uint32_t DEFAULT_BLOCK_SIZE = 1024u * 1024u;
+
+	/// Default number of blocks held in the cache.
+	static const unsigned int DEFAULT_BLOCK_COUNT = 64u;
+
+	/// Default number of blocks following a missing block that are fetched along with it.
+	static const unsigned int DEFAULT_PREFETCH_COUNT = 2u;
+
+	/// Maximum number of blocks following a missing block that are fetched along with it.
+	static const unsigned int MAX_PREFETCH_COUNT = 15u;
+
+	/// Constructor using the default block size, block count and prefetch count.
+	RangeFetchFile(Allocator* allocator, RangeFetcher* fetcher);
+
+	/// Constructor caching up to \a blockCount blocks of \a blockSize bytes each, fetching \a prefetchCount additional blocks
+	/// whenever a block is missing.
+	RangeFetchFile(Allocator* allocator, RangeFetcher* fetcher, uint32_t blockSize, unsigned int blockCount, unsigned int prefetchCount);
+
+	/// Destructor freeing the cache.
+	virtual ~RangeFetchFile(void);
+
+	/// Returns the cache statistics gathered so far.
+	Statistics GetStatistics(void) const;
+
+private:
+	struct Cache;
+	struct Block;
+
+	// the cache is owned by the file, hence it cannot be copied
+	RangeFetchFile(const RangeFetchFile&);
+	RangeFetchFile& operator=(const RangeFetchFile&);
+
+	void Initialize(uint32_t blockSize, unsigned int blockCount, unsigned int prefetchCount);
+	bool FetchRange(void* buffer, uint32_t count, uint64_t position);
+	bool AcquireBlock(uint64_t blockIndex, Block*& block);
+	void ReleaseBlock(Block* block);
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	RangeFetcher* m_fetcher;
+	uint64_t m_size;
+	Cache* m_cache;
+};
+
+PSD_NAMESPACE_END
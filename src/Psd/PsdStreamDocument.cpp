@@ -0,0 +1,52 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdStreamDocument.h"
+
+#include "PsdDocument.h"
+#include "PsdStreamListener.h"
+#include "PsdParseDocument.h"
+#include "PsdParseLayerMaskSection.h"
+#include "PsdParseImageDataSection.h"
+#include "PsdLayerMaskSection.h"
+#include "PsdAssert.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamDocument(File* file, Allocator* allocator, StreamListener* listener)
+{
+	PSD_ASSERT_NOT_NULL(file);
+	PSD_ASSERT_NOT_NULL(allocator);
+	PSD_ASSERT_NOT_NULL(listener);
+
+	Document* document = CreateDocument(file, allocator);
+	if (!document)
+		return false;
+
+	listener->OnDocument(document);
+
+	// sections are parsed in the order they are stored in. the image resources section is skipped.
+	if (document->layerMaskInfoSection.length != 0)
+	{
+		LayerMaskSection* layerMaskSection = StreamLayerMaskSection(document, file, allocator, listener);
+		if (!layerMaskSection)
+		{
+			DestroyDocument(document, allocator);
+			return false;
+		}
+
+		DestroyLayerMaskSection(layerMaskSection, allocator);
+	}
+
+	const bool success = StreamImageDataSection(document, file, allocator, listener);
+
+	DestroyDocument(document, allocator);
+
+	return success;
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,24 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+class File;
+class Allocator;
+class StreamListener;
+
+
+/// \ingroup Parser
+/// Parses a whole document in a single forward pass, handing the document, the records of all layers, the decoded data
+/// of each channel, and each row of the merged image to the \a listener in file order. Returns whether the document
+/// could be parsed completely, so that a stream ending early is reported as a failure.
+/// \remark The file never needs to seek backwards by more than the read-ahead window of a \ref SyncFileReader, which
+/// makes it possible to parse documents while they arrive through a \ref StreamFile. At most the compressed data of a
+/// single channel is held in memory at any time, apart from the data kept by the listener.
+/// \sa StreamListener StreamFile StreamLayerMaskSection StreamImageDataSection
+bool StreamDocument(File* file, Allocator* allocator, StreamListener* listener);
+
+PSD_NAMESPACE_END
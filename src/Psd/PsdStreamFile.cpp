@@ -0,0 +1,239 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdStreamFile.h"
+
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAssert.h"
+#include "PsdLog.h"
+#include "Psdinttypes.h"
+#include <cstring>
+
+
+PSD_NAMESPACE_BEGIN
+
+const uint64_t StreamFile::UNKNOWN_SIZE;
+const uint32_t StreamFile::DEFAULT_HISTORY_SIZE;
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+InputStream::~InputStream(void)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint32_t InputStream::Read(void* buffer, uint32_t count)
+{
+	return DoRead(buffer, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+StreamFile::StreamFile(Allocator* allocator, InputStream* stream, uint64_t size)
+	: File(allocator)
+	, m_stream(stream)
+	, m_size(size)
+	, m_position(0ull)
+	, m_history(nullptr)
+	, m_historyCapacity(DEFAULT_HISTORY_SIZE)
+	, m_historySize(0u)
+{
+	m_history = memoryUtil::AllocateArray<uint8_t>(allocator, m_historyCapacity);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+StreamFile::StreamFile(Allocator* allocator, InputStream* stream, uint64_t size, uint32_t historySize)
+	: File(allocator)
+	, m_stream(stream)
+	, m_size(size)
+	, m_position(0ull)
+	, m_history(nullptr)
+	, m_historyCapacity(historySize)
+	, m_historySize(0u)
+{
+	if (historySize != 0u)
+	{
+		m_history = memoryUtil::AllocateArray<uint8_t>(allocator, historySize);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+StreamFile::~StreamFile(void)
+{
+	memoryUtil::FreeArray(m_allocator, m_history);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamFile::Consume(uint8_t* buffer, uint32_t count)
+{
+	uint32_t done = 0u;
+	while (done < count)
+	{
+		const uint32_t read = m_stream->Read(buffer + done, count - done);
+		if (read == 0u)
+		{
+			// the stream ended early, the caller gets zeros for the missing bytes
+			memset(buffer + done, 0, count - done);
+			AppendHistory(buffer, done);
+			m_position += done;
+			return false;
+		}
+
+		done += read;
+	}
+
+	AppendHistory(buffer, count);
+	m_position += count;
+
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamFile::AppendHistory(const uint8_t* data, uint32_t count)
+{
+	if (count >= m_historyCapacity)
+	{
+		memcpy(m_history, data + count - m_historyCapacity, m_historyCapacity);
+		m_historySize = m_historyCapacity;
+		return;
+	}
+
+	// drop the oldest bytes to make room for the new ones
+	const uint32_t keep = (m_historySize + count > m_historyCapacity) ? (m_historyCapacity - count) : m_historySize;
+	memmove(m_history, m_history + m_historySize - keep, keep);
+	memcpy(m_history + keep, data, count);
+	m_historySize = keep + count;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamFile::DoOpenRead(const wchar_t*)
+{
+	PSD_ERROR("StreamFile", "Stream files cannot be opened by name.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamFile::DoOpenWrite(const wchar_t*)
+{
+	PSD_ERROR("StreamFile", "Stream files cannot be opened by name.");
+	return false;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamFile::DoClose(void)
+{
+	return true;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation StreamFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	if (!DoReadSync(buffer, count, position))
+		return nullptr;
+
+	// the read has already finished, so any non-null object will do
+	return static_cast<File::ReadOperation>(buffer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamFile::DoWaitForRead(File::ReadOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation StreamFile::DoWrite(const void*, uint32_t, uint64_t)
+{
+	PSD_ERROR("StreamFile", "Stream files cannot be written to.");
+	return nullptr;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamFile::DoWaitForWrite(File::WriteOperation& operation)
+{
+	return (operation != nullptr);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool StreamFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	const uint64_t historyStart = m_position - m_historySize;
+	if (position < historyStart)
+	{
+		PSD_ERROR("StreamFile", "Cannot read from file position %" PRIu64 ", stream has already advanced to %" PRIu64 ".", position, m_position);
+		return false;
+	}
+
+	uint8_t* dest = static_cast<uint8_t*>(buffer);
+
+	// serve bytes that have already been consumed from the history
+	if (position < m_position)
+	{
+		const uint32_t offset = static_cast<uint32_t>(position - historyStart);
+		const uint32_t available = m_historySize - offset;
+		const uint32_t toCopy = (count < available) ? count : available;
+
+		memcpy(dest, m_history + offset, toCopy);
+		dest += toCopy;
+		count -= toCopy;
+		position += toCopy;
+	}
+
+	if (count == 0u)
+		return true;
+
+	// skip the bytes up to the requested position, which only keeps the last of them in the history
+	uint8_t skipBuffer[4096];
+	while (position > m_position)
+	{
+		const uint64_t remaining = position - m_position;
+		const uint32_t toSkip = (remaining < sizeof(skipBuffer)) ? static_cast<uint32_t>(remaining) : static_cast<uint32_t>(sizeof(skipBuffer));
+		if (!Consume(skipBuffer, toSkip))
+		{
+			memset(dest, 0, count);
+			return false;
+		}
+	}
+
+	return Consume(dest, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t StreamFile::DoGetSize(void) const
+{
+	return m_size;
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,93 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Interfaces
+/// \ingroup Files
+/// \brief Base class for sources of data that can only be read front to back, e.g. pipes or sockets.
+/// \sa StreamFile
+class InputStream
+{
+public:
+	/// Empty destructor.
+	virtual ~InputStream(void);
+
+	/// Reads up to count bytes into the buffer, blocking until at least one byte is available. Returns the number of bytes
+	/// read, or 0 if the end of the stream has been reached or an error occurred.
+	uint32_t Read(void* buffer, uint32_t count);
+
+private:
+	virtual uint32_t DoRead(void* buffer, uint32_t count) PSD_ABSTRACT;
+};
+
+
+/// \ingroup Files
+/// \brief Read-only file implementation on top of an \ref InputStream, allowing documents to be parsed while they arrive.
+/// \details Reads must happen in increasing file order. Reads starting past the data consumed so far skip the bytes in
+/// between, and reads starting before it are served from a history of the most recently consumed bytes. The history
+/// is as large as the read-ahead window of a \ref SyncFileReader by default, which is what \ref StreamDocument needs to
+/// hand the stream from one section to the next.
+///
+/// If the size of the stream is not known up front, GetSize() returns the largest possible size, and reads past the end
+/// of the stream fail, filling the remaining bytes with zeros.
+///
+/// Files are open as soon as they are constructed, hence OpenRead() and OpenWrite() always fail. All operations are
+/// synchronous, and the file cannot be written to.
+/// \sa File InputStream StreamDocument
+class StreamFile : public File
+{
+public:
+	/// Size of a stream whose size is not known up front.
+	static const uint64_t UNKNOWN_SIZE = ~0ull;
+
+	/// Default size of the history of consumed bytes.
+	static const uint32_t DEFAULT_HISTORY_SIZE = 64u * 1024u;
+
+	/// Constructor reading a stream of \a size bytes, using a history of the default size.
+	StreamFile(Allocator* allocator, InputStream* stream, uint64_t size);
+
+	/// Constructor reading a stream of \a size bytes, keeping the last \a historySize consumed bytes.
+	StreamFile(Allocator* allocator, InputStream* stream, uint64_t size, uint32_t historySize);
+
+	/// Destructor freeing the history.
+	virtual ~StreamFile(void);
+
+private:
+	// the history is owned by the file, hence it cannot be copied
+	StreamFile(const StreamFile&);
+	StreamFile& operator=(const StreamFile&);
+
+	bool Consume(uint8_t* buffer, uint32_t count);
+	void AppendHistory(const uint8_t* data, uint32_t count);
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	InputStream* m_stream;
+	uint64_t m_size;
+	uint64_t m_position;
+
+	// holds the bytes [m_position - m_historySize, m_position)
+	uint8_t* m_history;
+	uint32_t m_historyCapacity;
+	uint32_t m_historySize;
+};
+
+PSD_NAMESPACE_END
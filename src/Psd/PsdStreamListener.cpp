@@ -0,0 +1,76 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdStreamListener.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+StreamListener::~StreamListener(void)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::OnDocument(const Document* document)
+{
+	DoOnDocument(document);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::OnLayerRecord(const Document* document, const Layer* layer)
+{
+	DoOnLayerRecord(document, layer);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::OnChannel(const Document* document, const Layer* layer, Channel* channel)
+{
+	DoOnChannel(document, layer, channel);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::OnMergedImageRow(const Document* document, unsigned int channelIndex, unsigned int row, const void* data)
+{
+	DoOnMergedImageRow(document, channelIndex, row, data);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::DoOnDocument(const Document*)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::DoOnLayerRecord(const Document*, const Layer*)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::DoOnChannel(const Document*, const Layer*, Channel*)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void StreamListener::DoOnMergedImageRow(const Document*, unsigned int, unsigned int, const void*)
+{
+}
+
+PSD_NAMESPACE_END
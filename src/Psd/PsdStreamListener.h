@@ -0,0 +1,50 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+
+PSD_NAMESPACE_BEGIN
+
+struct Document;
+struct Layer;
+struct Channel;
+
+
+/// \ingroup Interfaces
+/// \ingroup Parser
+/// \brief Base class for receiving the events emitted while parsing a document in a single forward pass.
+/// \details Events are emitted in file order: first the document, then the record of each layer, then the decoded data of
+/// each channel of each layer, and finally each row of each channel of the merged image. All methods do nothing by default,
+/// so implementations only need to override the events they are interested in.
+/// \sa StreamDocument StreamLayerMaskSection StreamImageDataSection
+class StreamListener
+{
+public:
+	/// Empty destructor.
+	virtual ~StreamListener(void);
+
+	/// Called once the header and the offsets of all sections are known.
+	void OnDocument(const Document* document);
+
+	/// Called for each layer once the records of all layers have been parsed, before any channel data is decoded.
+	/// The hierarchy of the layers is already known at this point.
+	void OnLayerRecord(const Document* document, const Layer* layer);
+
+	/// Called for each channel of each layer after its data has been decoded into planar data.
+	/// \remark The data is freed after the call returns. Implementations can take ownership of the data by setting the
+	/// channel's data to a nullptr, in which case they have to free it using the allocator passed to the parser.
+	void OnChannel(const Document* document, const Layer* layer, Channel* channel);
+
+	/// Called for each row of each channel of the merged image. The data holds one row of native-endian values, and is
+	/// only valid during the call.
+	void OnMergedImageRow(const Document* document, unsigned int channelIndex, unsigned int row, const void* data);
+
+private:
+	virtual void DoOnDocument(const Document* document);
+	virtual void DoOnLayerRecord(const Document* document, const Layer* layer);
+	virtual void DoOnChannel(const Document* document, const Layer* layer, Channel* channel);
+	virtual void DoOnMergedImageRow(const Document* document, unsigned int channelIndex, unsigned int row, const void* data);
+};
+
+PSD_NAMESPACE_END
@@ -5,16 +5,65 @@
 #include "PsdSyncFileReader.h"
 
 #include "PsdFile.h"
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include <cstring>
 
 
 PSD_NAMESPACE_BEGIN
 
+const uint32_t SyncFileReader::DEFAULT_READ_AHEAD_SIZE;
+
+
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 SyncFileReader::SyncFileReader(File* file)
 	: m_file(file)
+	, m_allocator(nullptr)
 	, m_position(0ull)
+	, m_window(nullptr)
+	, m_windowCapacity(0u)
+	, m_windowSize(0u)
+	, m_windowPosition(0ull)
+	, m_fileSize(0ull)
+	, m_hasFailed(false)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+SyncFileReader::SyncFileReader(File* file, Allocator* allocator, uint32_t readAheadSize)
+	: m_file(file)
+	, m_allocator(allocator)
+	, m_position(0ull)
+	, m_window(nullptr)
+	, m_windowCapacity(readAheadSize)
+	, m_windowSize(0u)
+	, m_windowPosition(0ull)
+	, m_fileSize(0ull)
+	, m_hasFailed(false)
+{
+	if (readAheadSize != 0u)
+	{
+		PSD_ASSERT_NOT_NULL(allocator);
+
+		// the window never extends past the end of the file, because the File interface cannot tell us how many bytes
+		// a read operation really returned.
+		m_window = memoryUtil::AllocateArray<uint8_t>(allocator, readAheadSize);
+		m_fileSize = file->GetSize();
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+SyncFileReader::~SyncFileReader(void)
 {
+	if (m_window)
+	{
+		memoryUtil::FreeArray(m_allocator, m_window);
+	}
 }
 
 
@@ -22,18 +71,98 @@ SyncFileReader::SyncFileReader(File* file)
 // ---------------------------------------------------------------------------------------------------------------------
 void SyncFileReader::Read(void* buffer, uint32_t count)
 {
-	// do an asynchronous read, wait until it's finished, and update the file position
-	File::ReadOperation op = m_file->Read(buffer, count, m_position);
-	m_file->WaitForRead(op);
+	// the failure has already been reported, so do not keep hammering a file that cannot be read
+	if (m_hasFailed)
+	{
+		memset(buffer, 0, count);
+		m_position += count;
+
+		return;
+	}
+
+	if (m_window)
+	{
+		uint8_t* dest = static_cast<uint8_t*>(buffer);
+
+		// serve as many bytes as possible from the current window
+		if ((m_position >= m_windowPosition) && (m_position < m_windowPosition + m_windowSize))
+		{
+			const uint32_t offset = static_cast<uint32_t>(m_position - m_windowPosition);
+			const uint32_t available = m_windowSize - offset;
+			const uint32_t toCopy = (count < available) ? count : available;
+
+			memcpy(dest, m_window + offset, toCopy);
+			dest += toCopy;
+			count -= toCopy;
+			m_position += toCopy;
+
+			if (count == 0u)
+				return;
+		}
+
+		// small reads refill the window, large reads go directly to the file
+		if (count < m_windowCapacity)
+		{
+			if (!FillWindow())
+			{
+				// the window could not be filled in full, which does not mean that the requested bytes are missing
+				m_windowSize = 0u;
+				if (!m_file->ReadSync(dest, count, m_position))
+				{
+					m_hasFailed = true;
+				}
+
+				m_position += count;
+
+				return;
+			}
+
+			const uint32_t toCopy = (count < m_windowSize) ? count : m_windowSize;
+			memcpy(dest, m_window, toCopy);
+			if (toCopy < count)
+			{
+				// the read extends past the end of the file
+				memset(dest + toCopy, 0, count - toCopy);
+				m_hasFailed = true;
+			}
+
+			m_position += count;
+
+			return;
+		}
+
+		buffer = dest;
+	}
+
+	// do a synchronous read and update the file position
+	if (!m_file->ReadSync(buffer, count, m_position))
+	{
+		m_hasFailed = true;
+	}
 
 	m_position += count;
 }
 
 
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+const void* SyncFileReader::ReadSpan(uint32_t count)
+{
+	const void* span = m_file->GetSpan(m_position, count);
+	if (span)
+	{
+		m_position += count;
+	}
+
+	return span;
+}
+
+
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 void SyncFileReader::Skip(uint64_t count)
 {
+	// no I/O is done here, the window is checked by the next call to Read()
 	m_position += count;
 }
 
@@ -53,4 +182,29 @@ uint64_t SyncFileReader::GetPosition(void) const
 	return m_position;
 }
 
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool SyncFileReader::HasFailed(void) const
+{
+	return m_hasFailed;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool SyncFileReader::FillWindow(void)
+{
+	m_windowPosition = m_position;
+	m_windowSize = 0u;
+
+	if (m_position >= m_fileSize)
+		return true;
+
+	const uint64_t remaining = m_fileSize - m_position;
+	m_windowSize = (remaining < m_windowCapacity) ? static_cast<uint32_t>(remaining) : m_windowCapacity;
+
+	return m_file->ReadSync(m_window, m_windowSize, m_windowPosition);
+}
+
 PSD_NAMESPACE_END
@@ -7,6 +7,7 @@
 PSD_NAMESPACE_BEGIN
 
 class File;
+class Allocator;
 
 
 /// \ingroup Files
@@ -14,17 +15,37 @@ class File;
 /// \details In certain situations, working with synchronous read operations is much easier than having to deal with a number
 /// of asynchronous reads, keeping track of individual read operations. This is especially true when parsing a file sequentially,
 /// where different read operations depend on previous ones.
+///
+/// Optionally, the reader can use a read-ahead window. Small reads are then served from memory, and the underlying \ref File
+/// is only accessed whenever a read leaves the window. Reads that are larger than the window bypass it.
 /// \sa File
 class SyncFileReader
 {
 public:
+	/// Default size of the read-ahead window used by the parsers.
+	static const uint32_t DEFAULT_READ_AHEAD_SIZE = 64u * 1024u;
+
 	/// Constructor initializing the internal read position to zero.
 	/// \remark The given \a file must already be open.
 	explicit SyncFileReader(File* file);
 
+	/// Constructor initializing the internal read position to zero, using a read-ahead window of \a readAheadSize bytes
+	/// allocated from \a allocator. A \a readAheadSize of zero disables the read-ahead window.
+	/// \remark The given \a file must already be open.
+	SyncFileReader(File* file, Allocator* allocator, uint32_t readAheadSize);
+
+	/// Destructor freeing the read-ahead window, if any.
+	~SyncFileReader(void);
+
 	/// Reads \a count bytes into \a buffer synchronously, incrementing the internal read position.
 	void Read(void* buffer, uint32_t count);
 
+	/// Returns a pointer to the next \a count bytes directly inside the file's memory, incrementing the internal read position.
+	/// If the underlying \ref File does not offer direct access, a nullptr is returned and the read position is left untouched,
+	/// in which case the data must be obtained using Read().
+	/// \sa File::GetSpan
+	const void* ReadSpan(uint32_t count);
+
 	/// Skips \a count bytes.
 	void Skip(uint64_t count);
 
@@ -34,9 +55,27 @@ public:
 	/// Returns the internal read position.
 	uint64_t GetPosition(void) const;
 
+	/// Returns whether any read so far failed, e.g. because it extended past the end of the file. Bytes that could not be
+	/// read are set to zero, and so are the bytes of all later reads, which no longer touch the file.
+	bool HasFailed(void) const;
+
 private:
+	// the read-ahead window is owned by the reader, hence it cannot be copied
+	SyncFileReader(const SyncFileReader&);
+	SyncFileReader& operator=(const SyncFileReader&);
+
+	bool FillWindow(void);
+
 	File* m_file;
+	Allocator* m_allocator;
 	uint64_t m_position;
+
+	uint8_t* m_window;
+	uint32_t m_windowCapacity;
+	uint32_t m_windowSize;
+	uint64_t m_windowPosition;
+	uint64_t m_fileSize;
+	bool m_hasFailed;
 };
 
 PSD_NAMESPACE_END
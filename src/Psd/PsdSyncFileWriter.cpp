@@ -5,16 +5,66 @@
 #include "PsdSyncFileWriter.h"
 
 #include "PsdFile.h"
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include <cstring>
 
 
 PSD_NAMESPACE_BEGIN
 
+const uint32_t SyncFileWriter::DEFAULT_STAGING_SIZE;
+const unsigned int SyncFileWriter::MAX_BATCH_SIZE;
+
+
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 SyncFileWriter::SyncFileWriter(File* file)
 	: m_file(file)
+	, m_allocator(nullptr)
+	, m_position(0ull)
+	, m_staging(nullptr)
+	, m_stagingCapacity(0u)
+	, m_stagingSize(0u)
+	, m_stagingRequestOffset(0u)
+	, m_requests(nullptr)
+	, m_requestCount(0u)
+{
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+SyncFileWriter::SyncFileWriter(File* file, Allocator* allocator, uint32_t stagingSize)
+	: m_file(file)
+	, m_allocator(allocator)
 	, m_position(0ull)
+	, m_staging(nullptr)
+	, m_stagingCapacity(stagingSize)
+	, m_stagingSize(0u)
+	, m_stagingRequestOffset(0u)
+	, m_requests(nullptr)
+	, m_requestCount(0u)
+{
+	if (stagingSize != 0u)
+	{
+		PSD_ASSERT_NOT_NULL(allocator);
+
+		m_staging = memoryUtil::AllocateArray<uint8_t>(allocator, stagingSize);
+		m_requests = memoryUtil::AllocateArray<File::WriteRequest>(allocator, MAX_BATCH_SIZE);
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+SyncFileWriter::~SyncFileWriter(void)
 {
+	if (m_staging)
+	{
+		Flush();
+		memoryUtil::FreeArray(m_allocator, m_requests);
+		memoryUtil::FreeArray(m_allocator, m_staging);
+	}
 }
 
 
@@ -22,14 +72,103 @@ SyncFileWriter::SyncFileWriter(File* file)
 // ---------------------------------------------------------------------------------------------------------------------
 void SyncFileWriter::Write(const void* buffer, uint32_t count)
 {
-	// do an asynchronous write, wait until it's finished, and update the file position
-	File::WriteOperation op = m_file->Write(buffer, count, m_position);
-	m_file->WaitForWrite(op);
+	if (m_staging)
+	{
+		// small writes are gathered in the staging buffer
+		if (count < m_stagingCapacity)
+		{
+			if (count > m_stagingCapacity - m_stagingSize)
+			{
+				Flush();
+			}
+
+			memcpy(m_staging + m_stagingSize, buffer, count);
+			m_stagingSize += count;
+			m_position += count;
+
+			return;
+		}
+
+		// large writes go directly to the file, but must not overtake data that is still staged
+		Flush();
+	}
+
+	// do a synchronous write and update the file position
+	m_file->WriteSync(buffer, count, m_position);
+
+	m_position += count;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void SyncFileWriter::WriteDeferred(const void* buffer, uint32_t count)
+{
+	if (!m_staging)
+	{
+		Write(buffer, count);
+		return;
+	}
+
+	// make room for the staged data written so far and the deferred write itself. one more request is always kept free for
+	// data staged after the last deferred write, which is only added by Flush().
+	if (m_requestCount + 3u > MAX_BATCH_SIZE)
+	{
+		Flush();
+	}
+
+	// staged data must end up in the file before the deferred data
+	AddStagedRequest();
+
+	File::WriteRequest& request = m_requests[m_requestCount++];
+	request.buffer = buffer;
+	request.count = count;
+	request.position = m_position;
 
 	m_position += count;
 }
 
 
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void SyncFileWriter::Flush(void)
+{
+	AddStagedRequest();
+
+	if (m_requestCount == 1u)
+	{
+		m_file->WriteSync(m_requests[0].buffer, m_requests[0].count, m_requests[0].position);
+	}
+	else if (m_requestCount > 1u)
+	{
+		// all requests directly follow each other, so files supporting vectored I/O can write them in one go
+		m_file->WriteBatch(m_requests, m_requestCount);
+	}
+
+	m_requestCount = 0u;
+	m_stagingSize = 0u;
+	m_stagingRequestOffset = 0u;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void SyncFileWriter::AddStagedRequest(void)
+{
+	const uint32_t count = m_stagingSize - m_stagingRequestOffset;
+	if (count == 0u)
+		return;
+
+	// the write position already accounts for all staged data
+	File::WriteRequest& request = m_requests[m_requestCount++];
+	request.buffer = m_staging + m_stagingRequestOffset;
+	request.count = count;
+	request.position = m_position - count;
+
+	m_stagingRequestOffset = m_stagingSize;
+}
+
+
 // ---------------------------------------------------------------------------------------------------------------------
 // ---------------------------------------------------------------------------------------------------------------------
 uint64_t SyncFileWriter::GetPosition(void) const
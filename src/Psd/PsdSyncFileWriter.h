@@ -3,33 +3,80 @@
 
 #pragma once
 
+#include "PsdFile.h"
+
 
 PSD_NAMESPACE_BEGIN
 
-class File;
+class Allocator;
 
 
 /// \ingroup Files
 /// \brief Synchronous file wrapper using an arbitrary \ref File implementation for sequential writes.
 /// \details In certain situations, working with synchronous write operations is much easier than having to deal with a number
 /// of asynchronous writes, keeping track of individual write operations. This is especially true when e.g. writing header information.
+///
+/// Optionally, the writer can use a staging buffer. Small writes are then gathered in memory, and only handed to the underlying
+/// \ref File whenever the buffer is full, or Flush() is called. Writes that are larger than the buffer bypass it.
+/// Additionally, large payloads can be written using WriteDeferred(), which does not copy them at all. They are handed to the
+/// file together with the surrounding staged data in a single \ref File::WriteBatch call.
 /// \sa File
 class SyncFileWriter
 {
 public:
+	/// Default size of the staging buffer used by the exporter.
+	static const uint32_t DEFAULT_STAGING_SIZE = 64u * 1024u;
+
+	/// Maximum number of writes gathered into a single batch. Each deferred write and each run of staged data counts as one.
+	static const unsigned int MAX_BATCH_SIZE = 64u;
+
 	/// Constructor initializing the internal write position to zero.
 	/// \remark The given \a file must already be open.
 	explicit SyncFileWriter(File* file);
 
+	/// Constructor initializing the internal write position to zero, using a staging buffer of \a stagingSize bytes
+	/// allocated from \a allocator. A \a stagingSize of zero disables the staging buffer.
+	/// \remark The given \a file must already be open.
+	SyncFileWriter(File* file, Allocator* allocator, uint32_t stagingSize);
+
+	/// Destructor flushing and freeing the staging buffer, if any.
+	~SyncFileWriter(void);
+
 	/// Writes \a count bytes from \a buffer synchronously, incrementing the internal write position.
+	/// \remark When using a staging buffer, the data might not have reached the file yet when this function returns.
 	void Write(const void* buffer, uint32_t count);
 
+	/// Writes \a count bytes from \a buffer without copying them, incrementing the internal write position.
+	/// \remark The data is only written upon the next call to Flush(), hence \a buffer must stay valid until then. Without a
+	/// staging buffer, this is the same as calling Write().
+	void WriteDeferred(const void* buffer, uint32_t count);
+
+	/// Writes all data held in the staging buffer and all deferred writes to the file.
+	void Flush(void);
+
 	/// Returns the internal write position.
 	uint64_t GetPosition(void) const;
 
 private:
+	// the staging buffer is owned by the writer, hence it cannot be copied
+	SyncFileWriter(const SyncFileWriter&);
+	SyncFileWriter& operator=(const SyncFileWriter&);
+
+	void AddStagedRequest(void);
+
 	File* m_file;
+	Allocator* m_allocator;
 	uint64_t m_position;
+
+	uint8_t* m_staging;
+	uint32_t m_stagingCapacity;
+	uint32_t m_stagingSize;
+
+	// staged data before this offset has already been turned into a request
+	uint32_t m_stagingRequestOffset;
+
+	File::WriteRequest* m_requests;
+	unsigned int m_requestCount;
 };
 
 PSD_NAMESPACE_END
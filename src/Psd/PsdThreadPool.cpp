@@ -0,0 +1,231 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdThreadPool.h"
+
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include "PsdAssert.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <new>
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct ThreadPool::QueuedTask
+{
+	enum State
+	{
+		QUEUED,
+		RUNNING,
+		FINISHED
+	};
+
+	TaskFunction function;
+	void* data;
+	QueuedTask* prev;				// only valid while the task is queued
+	QueuedTask* next;				// only valid while the task is queued
+	State state;
+};
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct ThreadPool::Queue
+{
+	std::mutex mutex;
+	std::condition_variable taskQueued;
+	std::condition_variable taskFinished;
+
+	QueuedTask* head;
+	QueuedTask* tail;
+	bool isStopping;
+
+	std::thread* threads;
+};
+
+
+namespace
+{
+	typedef std::unique_lock<std::mutex> QueueLock;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	template <typename Queue, typename QueuedTask>
+	static void Remove(Queue* queue, QueuedTask* task)
+	{
+		if (task->prev)
+		{
+			task->prev->next = task->next;
+		}
+		else
+		{
+			queue->head = task->next;
+		}
+
+		if (task->next)
+		{
+			task->next->prev = task->prev;
+		}
+		else
+		{
+			queue->tail = task->prev;
+		}
+
+		task->prev = nullptr;
+		task->next = nullptr;
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+ThreadPool::ThreadPool(Allocator* allocator, unsigned int threadCount)
+	: m_allocator(allocator)
+	, m_queue(nullptr)
+	, m_threadCount(threadCount)
+{
+	m_queue = memoryUtil::Allocate<Queue>(m_allocator);
+	m_queue->head = nullptr;
+	m_queue->tail = nullptr;
+	m_queue->isStopping = false;
+	m_queue->threads = nullptr;
+
+	if (threadCount != 0u)
+	{
+		m_queue->threads = static_cast<std::thread*>(m_allocator->Allocate(threadCount * sizeof(std::thread), PSD_ALIGN_OF(std::thread)));
+		for (unsigned int i = 0u; i < threadCount; ++i)
+		{
+			new (&m_queue->threads[i]) std::thread(&ThreadPool::RunWorker, this);
+		}
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+ThreadPool::~ThreadPool(void)
+{
+	Queue* queue = m_queue;
+	{
+		QueueLock lock(queue->mutex);
+		PSD_ASSERT(queue->head == nullptr, "Tasks submitted to the thread pool have not been waited for.");
+		queue->isStopping = true;
+	}
+	queue->taskQueued.notify_all();
+
+	for (unsigned int i = 0u; i < m_threadCount; ++i)
+	{
+		queue->threads[i].join();
+		queue->threads[i].~thread();
+	}
+
+	m_allocator->Free(queue->threads);
+	memoryUtil::Free(m_allocator, m_queue);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+unsigned int ThreadPool::GetThreadCount(void) const
+{
+	return m_threadCount;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void ThreadPool::RunWorker(void)
+{
+	Queue* queue = m_queue;
+	QueueLock lock(queue->mutex);
+	for (;;)
+	{
+		while (!queue->head && !queue->isStopping)
+		{
+			queue->taskQueued.wait(lock);
+		}
+
+		if (!queue->head)
+			return;
+
+		QueuedTask* task = queue->head;
+		Remove(queue, task);
+		task->state = QueuedTask::RUNNING;
+
+		lock.unlock();
+		task->function(task->data);
+		lock.lock();
+
+		task->state = QueuedTask::FINISHED;
+		queue->taskFinished.notify_all();
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+Executor::Task ThreadPool::DoSubmit(TaskFunction function, void* data)
+{
+	QueuedTask* task = memoryUtil::Allocate<QueuedTask>(m_allocator);
+	task->function = function;
+	task->data = data;
+	task->next = nullptr;
+	task->state = QueuedTask::QUEUED;
+
+	Queue* queue = m_queue;
+	{
+		QueueLock lock(queue->mutex);
+		task->prev = queue->tail;
+		if (queue->tail)
+		{
+			queue->tail->next = task;
+		}
+		else
+		{
+			queue->head = task;
+		}
+		queue->tail = task;
+	}
+	queue->taskQueued.notify_one();
+
+	return task;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void ThreadPool::DoWait(Task& task)
+{
+	QueuedTask* queuedTask = static_cast<QueuedTask*>(task);
+	Queue* queue = m_queue;
+
+	QueueLock lock(queue->mutex);
+	if (queuedTask->state == QueuedTask::QUEUED)
+	{
+		// no worker has started the task yet, so the waiting thread carries it out on its own
+		Remove(queue, queuedTask);
+		queuedTask->state = QueuedTask::RUNNING;
+		lock.unlock();
+
+		queuedTask->function(queuedTask->data);
+	}
+	else
+	{
+		while (queuedTask->state != QueuedTask::FINISHED)
+		{
+			queue->taskFinished.wait(lock);
+		}
+		lock.unlock();
+	}
+
+	memoryUtil::Free(m_allocator, queuedTask);
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,52 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdExecutor.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+class Allocator;
+
+
+/// \ingroup Executors
+/// \brief Simple executor that carries out tasks on a fixed number of worker threads.
+/// \details Submitted tasks are queued in order and picked up by the next idle worker. Waiting for a task that no worker
+/// has started yet takes it out of the queue and runs it on the waiting thread instead, which keeps tasks that wait for
+/// other tasks from deadlocking the pool, and lets a pool without any worker threads run all tasks inline.
+/// \remark Tasks are allocated and freed using the given allocator from whichever thread submits or waits for them, so the
+/// allocator must be thread-safe if tasks are submitted from several threads.
+/// \sa Executor
+class ThreadPool : public Executor
+{
+public:
+	/// Constructor starting \a threadCount worker threads.
+	ThreadPool(Allocator* allocator, unsigned int threadCount);
+
+	/// Destructor stopping all worker threads. All submitted tasks must have been waited for before.
+	virtual ~ThreadPool(void);
+
+	/// Returns the number of worker threads.
+	unsigned int GetThreadCount(void) const;
+
+private:
+	struct Queue;
+	struct QueuedTask;
+
+	// the worker threads are owned by the pool, hence it cannot be copied
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void RunWorker(void);
+
+	virtual Task DoSubmit(TaskFunction function, void* data) PSD_OVERRIDE;
+	virtual void DoWait(Task& task) PSD_OVERRIDE;
+
+	Allocator* m_allocator;
+	Queue* m_queue;
+	unsigned int m_threadCount;
+};
+
+PSD_NAMESPACE_END
@@ -0,0 +1,312 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#include "PsdPch.h"
+#include "PsdThrottledFile.h"
+
+#include "PsdAllocator.h"
+#include "PsdMemoryUtil.h"
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+
+PSD_NAMESPACE_BEGIN
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct ThrottledFile::Link
+{
+	std::mutex mutex;
+
+	uint64_t latency;				// in nanoseconds
+	uint64_t jitter;				// in nanoseconds
+	uint64_t bandwidth;				// in bytes per second
+	uint64_t random;				// state of the jitter sequence
+	uint64_t freeTime;				// time at which all scheduled bytes have been transferred
+};
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+struct ThrottledFile::Operation
+{
+	void* operation;
+	uint64_t finishTime;
+};
+
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static uint64_t GetTimestamp(void)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count());
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static uint64_t NextRandom(uint64_t& state)
+	{
+		// xorshift64*, state must never be zero
+		state ^= state >> 12u;
+		state ^= state << 25u;
+		state ^= state >> 27u;
+		return state * 0x2545F4914F6CDD1Dull;
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+ThrottledFile::ThrottledFile(Allocator* allocator, File* file, uint32_t latency, uint32_t jitter, uint64_t bandwidth, uint64_t seed)
+	: File(allocator)
+	, m_file(file)
+	, m_link(nullptr)
+{
+	m_link = memoryUtil::Allocate<Link>(m_allocator);
+	m_link->latency = latency * 1000ull;
+	m_link->jitter = jitter * 1000ull;
+	m_link->bandwidth = bandwidth;
+	m_link->random = seed ? seed : 0x9E3779B97F4A7C15ull;
+	m_link->freeTime = 0u;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+ThrottledFile::~ThrottledFile(void)
+{
+	memoryUtil::Free(m_allocator, m_link);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t ThrottledFile::Schedule(uint64_t count)
+{
+	Link* link = m_link;
+	const uint64_t now = GetTimestamp();
+
+	std::lock_guard<std::mutex> lock(link->mutex);
+
+	uint64_t finishTime = now + link->latency;
+	if (link->jitter != 0u)
+	{
+		finishTime += NextRandom(link->random) % (link->jitter + 1u);
+	}
+
+	if (link->bandwidth != 0u)
+	{
+		// bytes are transferred one operation after the other, starting once the link is free
+		const uint64_t start = (link->freeTime > now) ? link->freeTime : now;
+		const uint64_t transferTime = (count * 1000000000ull) / link->bandwidth;
+		link->freeTime = start + transferTime;
+
+		if (link->freeTime > finishTime)
+		{
+			finishTime = link->freeTime;
+		}
+	}
+
+	return finishTime;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+void ThrottledFile::WaitUntil(uint64_t time) const
+{
+	const uint64_t now = GetTimestamp();
+	if (time > now)
+	{
+		std::this_thread::sleep_for(std::chrono::nanoseconds(time - now));
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoOpenRead(const wchar_t* filename)
+{
+	return m_file->OpenRead(filename);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoOpenWrite(const wchar_t* filename)
+{
+	return m_file->OpenWrite(filename);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoClose(void)
+{
+	return m_file->Close();
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::ReadOperation ThrottledFile::DoRead(void* buffer, uint32_t count, uint64_t position)
+{
+	Operation* operation = memoryUtil::Allocate<Operation>(m_allocator);
+	operation->finishTime = Schedule(count);
+	operation->operation = m_file->Read(buffer, count, position);
+
+	// a read that could not be issued has no operation to wait for
+	if (!operation->operation)
+	{
+		memoryUtil::Free(m_allocator, operation);
+		return nullptr;
+	}
+
+	return operation;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoWaitForRead(File::ReadOperation& readOperation)
+{
+	Operation* operation = static_cast<Operation*>(readOperation);
+	if (!operation)
+		return false;
+
+	const bool success = m_file->WaitForRead(operation->operation);
+	WaitUntil(operation->finishTime);
+
+	memoryUtil::Free(m_allocator, operation);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+File::WriteOperation ThrottledFile::DoWrite(const void* buffer, uint32_t count, uint64_t position)
+{
+	Operation* operation = memoryUtil::Allocate<Operation>(m_allocator);
+	operation->finishTime = Schedule(count);
+	operation->operation = m_file->Write(buffer, count, position);
+
+	// a write that could not be issued has no operation to wait for
+	if (!operation->operation)
+	{
+		memoryUtil::Free(m_allocator, operation);
+		return nullptr;
+	}
+
+	return operation;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoWaitForWrite(File::WriteOperation& writeOperation)
+{
+	Operation* operation = static_cast<Operation*>(writeOperation);
+	if (!operation)
+		return false;
+
+	const bool success = m_file->WaitForWrite(operation->operation);
+	WaitUntil(operation->finishTime);
+
+	memoryUtil::Free(m_allocator, operation);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoReadSync(void* buffer, uint32_t count, uint64_t position)
+{
+	const uint64_t finishTime = Schedule(count);
+	const bool success = m_file->ReadSync(buffer, count, position);
+	WaitUntil(finishTime);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoWriteSync(const void* buffer, uint32_t count, uint64_t position)
+{
+	const uint64_t finishTime = Schedule(count);
+	const bool success = m_file->WriteSync(buffer, count, position);
+	WaitUntil(finishTime);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoReadBatch(const ReadRequest* requests, unsigned int count)
+{
+	uint64_t byteCount = 0u;
+	for (unsigned int i = 0u; i < count; ++i)
+	{
+		byteCount += requests[i].count;
+	}
+
+	const uint64_t finishTime = Schedule(byteCount);
+	const bool success = m_file->ReadBatch(requests, count);
+	WaitUntil(finishTime);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoWriteBatch(const WriteRequest* requests, unsigned int count)
+{
+	uint64_t byteCount = 0u;
+	for (unsigned int i = 0u; i < count; ++i)
+	{
+		byteCount += requests[i].count;
+	}
+
+	const uint64_t finishTime = Schedule(byteCount);
+	const bool success = m_file->WriteBatch(requests, count);
+	WaitUntil(finishTime);
+
+	return success;
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoPreallocate(uint64_t size)
+{
+	return m_file->Preallocate(size);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+bool ThrottledFile::DoPrefetch(uint64_t position, uint64_t count)
+{
+	return m_file->Prefetch(position, count);
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+uint64_t ThrottledFile::DoGetSize(void) const
+{
+	return m_file->GetSize();
+}
+
+PSD_NAMESPACE_END
@@ -0,0 +1,71 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+#pragma once
+
+#include "PsdFile.h"
+
+
+PSD_NAMESPACE_BEGIN
+
+/// \ingroup Files
+/// \brief File decorator that slows down all I/O operations carried out on any other file, simulating remote storage.
+/// \details Each operation is delayed by a fixed latency plus a random jitter, and all operations share a link of limited
+/// bandwidth: the bytes of an operation are transferred after the bytes of all operations issued before it. An operation
+/// finishes when both its latency has passed and its bytes have been transferred, whichever comes last, but never before the
+/// wrapped file has finished it.
+///
+/// Asynchronous operations are delayed when waiting for them, so that operations in flight overlap their latencies just
+/// like they would with network storage. A batch counts as a single operation transferring the bytes of all its requests.
+///
+/// The jitter is drawn from a pseudo-random sequence starting at the given seed, so that runs issuing the same operations
+/// in the same order are delayed identically.
+/// \remark Spans are not forwarded, because accessing them could not be delayed.
+/// \remark Asynchronous operations are tracked using a small object obtained from the allocator.
+/// \sa File
+class ThrottledFile : public File
+{
+public:
+	/// Constructor wrapping the given file, which is opened and closed through the decorator. Each operation is delayed by
+	/// \a latency plus up to \a jitter microseconds. Transfers are limited to \a bandwidth bytes per second, or unlimited if
+	/// \a bandwidth is zero.
+	ThrottledFile(Allocator* allocator, File* file, uint32_t latency, uint32_t jitter, uint64_t bandwidth, uint64_t seed);
+
+	/// Destructor.
+	virtual ~ThrottledFile(void);
+
+private:
+	struct Link;
+	struct Operation;
+
+	// the link is owned by the file, hence it cannot be copied
+	ThrottledFile(const ThrottledFile&);
+	ThrottledFile& operator=(const ThrottledFile&);
+
+	uint64_t Schedule(uint64_t count);
+	void WaitUntil(uint64_t time) const;
+
+	virtual bool DoOpenRead(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoOpenWrite(const wchar_t* filename) PSD_OVERRIDE;
+	virtual bool DoClose(void) PSD_OVERRIDE;
+
+	virtual File::ReadOperation DoRead(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForRead(File::ReadOperation& operation) PSD_OVERRIDE;
+
+	virtual File::WriteOperation DoWrite(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWaitForWrite(File::WriteOperation& operation) PSD_OVERRIDE;
+
+	virtual bool DoReadSync(void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoWriteSync(const void* buffer, uint32_t count, uint64_t position) PSD_OVERRIDE;
+	virtual bool DoReadBatch(const ReadRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual bool DoWriteBatch(const WriteRequest* requests, unsigned int count) PSD_OVERRIDE;
+	virtual bool DoPreallocate(uint64_t size) PSD_OVERRIDE;
+	virtual bool DoPrefetch(uint64_t position, uint64_t count) PSD_OVERRIDE;
+
+	virtual uint64_t DoGetSize(void) const PSD_OVERRIDE;
+
+	File* m_file;
+	Link* m_link;
+};
+
+PSD_NAMESPACE_END
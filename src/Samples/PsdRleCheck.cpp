@@ -0,0 +1,249 @@
+// Copyright 2011-2020, Molecular Matters GmbH <office@molecular-matters.com>
+// See LICENSE.txt for licensing details (2-clause BSD License: https://opensource.org/licenses/BSD-2-Clause)
+
+// a standalone check comparing imageUtil::DecompressRle, including its SSE2 fast path, against a plain scalar decoder.
+// random valid, truncated, and corrupted streams are decoded by both, and their output must be byte-identical. bytes past
+// the end of the destination buffer must never be touched.
+// note that the library logs an error for every malformed stream it decodes, so expect lots of output on stdout.
+
+#include "../Psd/Psd.h"
+#include "../Psd/PsdDecompressRle.h"
+
+PSD_PUSH_WARNING_LEVEL(0)
+	#include <vector>
+	#include <random>
+PSD_POP_WARNING_LEVEL
+
+#include <cstdio>
+#include <cstring>
+
+PSD_USING_NAMESPACE;
+
+
+namespace
+{
+	// the fast path only runs while at least this many bytes are left in both buffers, see PsdDecompressRle.cpp
+	static const unsigned int MAX_TOKEN_SIZE = 128u;
+
+	// bytes following the destination buffer, which must still hold their original value after decoding
+	static const unsigned int GUARD_SIZE = 256u;
+	static const uint8_t GUARD_VALUE = 0xCDu;
+
+	static const unsigned int ITERATIONS_PER_SIZE = 64u;
+	static const unsigned int RANDOM_SIZE_COUNT = 20000u;
+	static const unsigned int MAX_RANDOM_SIZE = 20000u;
+
+
+	enum StreamType
+	{
+		STREAM_VALID = 0,
+		STREAM_TRUNCATED,
+		STREAM_CORRUPTED,
+		STREAM_OVERLONG,
+		STREAM_TYPE_COUNT
+	};
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void DecompressRleScalar(const uint8_t* src, unsigned int srcSize, uint8_t* dest, unsigned int size)
+	{
+		unsigned int srcOffset = 0u;
+		unsigned int destOffset = 0u;
+		while ((destOffset < size) && (srcOffset < srcSize))
+		{
+			const uint8_t byte = src[srcOffset++];
+			if (byte == 0x80)
+			{
+				// no-op
+			}
+			else if (byte > 0x80)
+			{
+				if (srcOffset >= srcSize)
+					break;
+
+				const unsigned int count = 257u - byte;
+				const uint8_t value = src[srcOffset++];
+				for (unsigned int i = 0u; (i < count) && (destOffset < size); ++i)
+				{
+					dest[destOffset++] = value;
+				}
+			}
+			else
+			{
+				const unsigned int count = byte + 1u;
+				for (unsigned int i = 0u; (i < count) && (srcOffset < srcSize) && (destOffset < size); ++i)
+				{
+					dest[destOffset++] = src[srcOffset++];
+				}
+			}
+		}
+
+		// whatever cannot be decoded is set to zero
+		while (destOffset < size)
+		{
+			dest[destOffset++] = 0u;
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void EncodeRandomTokens(std::mt19937& random, std::vector<uint8_t>& stream, unsigned int size)
+	{
+		// prefer the largest tokens every now and then, because they are the ones that just fit into the margin
+		unsigned int left = size;
+		while (left > 0u)
+		{
+			const unsigned int kind = random() % 8u;
+			unsigned int count = (kind < 2u) ? MAX_TOKEN_SIZE : 1u + random() % MAX_TOKEN_SIZE;
+			if (count > left)
+			{
+				count = left;
+			}
+
+			if (kind == 7u)
+			{
+				stream.push_back(0x80u);
+			}
+			else if ((kind & 1u) && (count > 1u))
+			{
+				stream.push_back(static_cast<uint8_t>(257u - count));
+				stream.push_back(static_cast<uint8_t>(random()));
+				left -= count;
+			}
+			else
+			{
+				stream.push_back(static_cast<uint8_t>(count - 1u));
+				for (unsigned int i = 0u; i < count; ++i)
+				{
+					stream.push_back(static_cast<uint8_t>(random()));
+				}
+				left -= count;
+			}
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void EncodeRandomImage(std::mt19937& random, std::vector<uint8_t>& stream, unsigned int size)
+	{
+		// CompressRle() needs at least a single byte to compress
+		if (size == 0u)
+			return;
+
+		// rows as they are found in images, compressed by the library itself
+		std::vector<uint8_t> data(size);
+		const unsigned int runLikelihood = 1u + random() % 16u;
+		for (unsigned int i = 0u; i < size; ++i)
+		{
+			data[i] = ((i > 0u) && (random() % runLikelihood != 0u)) ? data[i - 1u] : static_cast<uint8_t>(random());
+		}
+
+		stream.resize(size * 2u);
+		stream.resize(imageUtil::CompressRle(&data[0], &stream[0], size));
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static void BuildStream(std::mt19937& random, std::vector<uint8_t>& stream, unsigned int size, StreamType type)
+	{
+		stream.clear();
+		if (random() % 2u)
+		{
+			EncodeRandomTokens(random, stream, (type == STREAM_OVERLONG) ? size + 1u + random() % (2u * MAX_TOKEN_SIZE) : size);
+		}
+		else
+		{
+			EncodeRandomImage(random, stream, size);
+			if (type == STREAM_OVERLONG)
+			{
+				EncodeRandomTokens(random, stream, 1u + random() % (2u * MAX_TOKEN_SIZE));
+			}
+		}
+
+		const unsigned int streamSize = static_cast<unsigned int>(stream.size());
+		if ((type == STREAM_TRUNCATED) && (streamSize > 0u))
+		{
+			// cut right at the margin of the fast path in some cases
+			const unsigned int cut = (random() % 4u == 0u) ? MAX_TOKEN_SIZE + random() % 2u : random() % streamSize;
+			stream.resize((cut < streamSize) ? cut : streamSize - 1u);
+		}
+		else if ((type == STREAM_CORRUPTED) && (streamSize > 0u))
+		{
+			const unsigned int corruptCount = 1u + random() % 4u;
+			for (unsigned int i = 0u; i < corruptCount; ++i)
+			{
+				stream[random() % streamSize] = static_cast<uint8_t>(random());
+			}
+		}
+	}
+
+
+	// ---------------------------------------------------------------------------------------------------------------------
+	// ---------------------------------------------------------------------------------------------------------------------
+	static bool Check(std::mt19937& random, unsigned int size, StreamType type)
+	{
+		std::vector<uint8_t> stream;
+		BuildStream(random, stream, size, type);
+
+		// the stream is copied into an allocation of exactly its size, so that memory checkers catch reads past its end
+		const std::vector<uint8_t> src(stream.begin(), stream.end());
+		const unsigned int srcSize = static_cast<unsigned int>(src.size());
+		const uint8_t* srcData = src.empty() ? &GUARD_VALUE : &src[0];
+
+		std::vector<uint8_t> expected(size + GUARD_SIZE, GUARD_VALUE);
+		std::vector<uint8_t> actual(size + GUARD_SIZE, GUARD_VALUE);
+		DecompressRleScalar(srcData, srcSize, &expected[0], size);
+		imageUtil::DecompressRle(srcData, srcSize, &actual[0], size);
+
+		if (memcmp(&expected[0], &actual[0], size) != 0)
+		{
+			fprintf(stderr, "Output differs: size %u, stream of %u bytes, stream type %u.\n", size, srcSize, static_cast<unsigned int>(type));
+			return false;
+		}
+
+		for (unsigned int i = 0u; i < GUARD_SIZE; ++i)
+		{
+			if (actual[size + i] != GUARD_VALUE)
+			{
+				fprintf(stderr, "Byte %u past the end was written: size %u, stream of %u bytes, stream type %u.\n", i, size, srcSize, static_cast<unsigned int>(type));
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------------------------------------------------------------------------
+int main(void)
+{
+	std::mt19937 random(0x5053u);
+	unsigned int checkCount = 0u;
+	unsigned int failureCount = 0u;
+
+	// every size around the margin of the fast path, followed by random sizes
+	for (unsigned int size = 0u; size <= 4u * MAX_TOKEN_SIZE; ++size)
+	{
+		for (unsigned int i = 0u; i < ITERATIONS_PER_SIZE; ++i)
+		{
+			failureCount += Check(random, size, static_cast<StreamType>(i % STREAM_TYPE_COUNT)) ? 0u : 1u;
+			++checkCount;
+		}
+	}
+
+	for (unsigned int i = 0u; i < RANDOM_SIZE_COUNT; ++i)
+	{
+		failureCount += Check(random, random() % MAX_RANDOM_SIZE, static_cast<StreamType>(i % STREAM_TYPE_COUNT)) ? 0u : 1u;
+		++checkCount;
+	}
+
+	fprintf(stderr, "%u of %u RLE checks failed.\n", failureCount, checkCount);
+
+	return (failureCount == 0u) ? 0 : 1;
+}